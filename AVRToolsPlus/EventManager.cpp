@@ -34,6 +34,25 @@
 
 #include <util/atomic.h>
 
+#if EVENTMANAGER_IDLE_SLEEP
+#include <avr/interrupt.h>
+#endif
+
+#if EVENTMANAGER_LISTENER_TABLES || EVENTMANAGER_SECTION_LISTENERS
+#include <avr/pgmspace.h>
+#endif
+
+
+#if EVENTMANAGER_SECTION_LISTENERS
+// Bounds of the listeners registered with EVENTMANAGER_REGISTER_LISTENER(), defined by the linker
+// (weak, so that they are null if nothing was registered)
+extern "C"
+{
+    extern const EventManager::ListenerTableEntry __start_evtmgr_listeners[] __attribute__(( weak ));
+    extern const EventManager::ListenerTableEntry __stop_evtmgr_listeners[] __attribute__(( weak ));
+}
+#endif
+
 
 
 
@@ -42,6 +61,26 @@
 namespace EventManager
 {
 
+    // Bit sets indexed by event code, used internally by EventManager
+    const int kEventCodeBitSetSize = ( EVENTMANAGER_NUM_EVENT_CODES + 7 ) / 8;
+
+    inline bool isBitSet( const volatile uint8_t* bits, int n )
+    {
+        return bits[ n >> 3 ] & ( 1 << ( n & 7 ) );
+    }
+
+    inline void setBit( volatile uint8_t* bits, int n )
+    {
+        bits[ n >> 3 ] |= ( 1 << ( n & 7 ) );
+    }
+
+    inline void clearBit( volatile uint8_t* bits, int n )
+    {
+        bits[ n >> 3 ] &= ~( 1 << ( n & 7 ) );
+    }
+
+
+
     // EventQueue class used internally by EventManager
     class EventQueue
     {
@@ -49,7 +88,30 @@ namespace EventManager
     public:
 
         // Queue constructor
-        EventQueue();
+        // Everything starts out zero (an empty slot holds kEventNone, which is 0), so the
+        // queue is constant-initialized and needs no code to run before main()
+        constexpr EventQueue() :
+        mEventQueue{},
+        mEventQueueHead( 0 ),
+        mEventQueueTail( 0 ),
+        mNumEvents( 0 )
+#if EVENTMANAGER_MPSC_QUEUE
+        ,
+        mReady{}
+#endif
+#if EVENTMANAGER_DEDUPLICATION
+        ,
+        mPendingSlot{}
+#endif
+#if EVENTMANAGER_QUEUE_WATERMARKS
+        ,
+        mHighWatermark( 0 ),
+        mLowWatermark( 0 ),
+        mThrottled( false ),
+        mWatermarkCallback( 0 )
+#endif
+        {
+        }
 
         // Returns true if no events are in the queue
         bool isEmpty();
@@ -62,15 +124,24 @@ namespace EventManager
 
         // Tries to insert an event into the queue;
         // Returns true if successful, false if the queue if full and the event cannot be inserted
+        // If merged is not null, *merged is set to true if the event was merged with an identical
+        // pending event (see EVENTMANAGER_DEDUPLICATION) instead of taking up a slot
         //
         // NOTE: if EventManager is instantiated in interrupt safe mode, this function can be called
         // from interrupt handlers.  This is the ONLY EventManager function that can be called from
         // an interrupt.
-        bool queueEvent( int eventCode, int eventParam );
+        bool queueEvent( int eventCode, int eventParam, bool* merged = 0 );
 
         // Tries to extract an event from the queue;
         // Returns true if successful, false if the queue is empty (the parameteres are not touched in this case)
-        bool popEvent( int* eventCode, int* eventParam );
+        // If timestamps are enabled and timestamp is not null, the event's enqueue time is stored there
+        bool popEvent( int* eventCode, int* eventParam, uint16_t* timestamp = 0 );
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+        // Set the flow control watermarks and callback (a zero high watermark disables the callback)
+        // Returns false if the watermarks are invalid
+        bool setWatermarks( uint8_t highWatermark, uint8_t lowWatermark, QueueWatermarkCallback callback );
+#endif
 
     private:
 
@@ -83,6 +154,9 @@ namespace EventManager
         {
             int code;	// each event is represented by an integer code
             int param;	// each event has a single integer parameter
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+            uint16_t stamp;	// tick count when the event was queued
+#endif
         };
 
         // The event queue
@@ -94,10 +168,186 @@ namespace EventManager
         // Index of event queue tail
         int mEventQueueTail;
 
+        // Actual number of events in queue
+        int mNumEvents;
+
+#if EVENTMANAGER_MPSC_QUEUE
+        // Non-zero once the producer that reserved a slot has finished writing the event into it
+        volatile uint8_t mReady[ kEventQueueSize ];
+#endif
+
+        // Index following i, wrapping around at the end of the queue
+        static int nextIndex( int i );
+
+        // Copy an event into or out of a slot of the queue
+        void storeEvent( int slot, int eventCode, int eventParam, uint16_t stamp );
+        void loadEvent( int slot, int* eventCode, int* eventParam, uint16_t* timestamp );
+
+#if EVENTMANAGER_DEDUPLICATION
+        // For each deduplicated event code, 1 + the slot holding the most recently queued event
+        // with that code, or 0 if no such event is in the queue.  A new event only needs to be
+        // compared with that one slot, and the entry is cleared when that slot is popped (any
+        // older events with the same code are ahead of it, so they are gone by then).
+        uint8_t mPendingSlot[ EVENTMANAGER_NUM_EVENT_CODES ];
+#endif
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+        // Flow control: the callback is called with true when the queue fills to mHighWatermark,
+        // then with false when it drains to mLowWatermark; mThrottled remembers which was last
+        uint8_t                 mHighWatermark;
+        uint8_t                 mLowWatermark;
+        bool                    mThrottled;
+        QueueWatermarkCallback  mWatermarkCallback;
+#endif
+    };
+
+
+#if EVENTMANAGER_BACKLOG_SIZE
+
+    // EventBacklog class used internally by EventManager
+    // A plain FIFO that is only ever used by the main loop, so unlike EventQueue it needs no
+    // protection from interrupts; low priority events are moved into it from mLowPriorityQueue
+    class EventBacklog
+    {
+
+    public:
+
+        // Backlog constructor (constant-initialized, like EventQueue)
+        constexpr EventBacklog() :
+        mEvents{},
+        mHead( 0 ),
+        mTail( 0 ),
+        mNumEvents( 0 )
+#if EVENTMANAGER_DEDUPLICATION
+        ,
+        mPendingSlot{}
+#endif
+        {
+        }
+
+        // Returns true if no events are in the backlog
+        bool isEmpty();
+
+        // Returns true if no more events can be inserted into the backlog
+        bool isFull();
+
+        // Actual number of events in backlog
+        int getNumEvents();
+
+        // Move as many events as fit from queue into the backlog (oldest first)
+        void spill( EventQueue& queue );
+
+        // Tries to extract an event from the backlog;
+        // Returns true if successful, false if the backlog is empty (the parameteres are not touched in this case)
+        // If timestamps are enabled and timestamp is not null, the event's enqueue time is stored there
+        bool popEvent( int* eventCode, int* eventParam, uint16_t* timestamp = 0 );
+
+    private:
+
+        static const int kBacklogSize = EVENTMANAGER_BACKLOG_SIZE;
+
+        struct EventElement
+        {
+            int code;
+            int param;
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+            uint16_t stamp;
+#endif
+        };
+
+        EventElement mEvents[ kBacklogSize ];
+
+        // Index of backlog head and tail, and actual number of events in backlog
+        int mHead;
+        int mTail;
+        int mNumEvents;
+
+#if EVENTMANAGER_DEDUPLICATION
+#if EVENTMANAGER_BACKLOG_SIZE < 255
+        typedef uint8_t SlotIndex;
+#else
+        typedef uint16_t SlotIndex;
+#endif
+
+        // For each deduplicated event code, 1 + the slot holding the most recently spilled event
+        // with that code, or 0 if no such event is in the backlog (as EventQueue::mPendingSlot)
+        SlotIndex mPendingSlot[ EVENTMANAGER_NUM_EVENT_CODES ];
+
+        // Returns true if eventCode is deduplicated and the most recent event with that code
+        // in the backlog is identical
+        bool isDuplicate( int eventCode, int eventParam );
+#endif
+    };
+
+#endif
+
+
+#if EVENTMANAGER_DEDUPLICATION
+    // Event codes for which identical pending events are not queued twice
+    uint8_t                     mDeduplicatedCodes[ kEventCodeBitSetSize ];
+#endif
+
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+
+    // DeadlineQueue class used internally by EventManager
+    // Events are kept in a binary min-heap ordered by deadline, so the event with the
+    // earliest deadline is always popped first
+    class DeadlineQueue
+    {
+
+    public:
+
+        // Queue constructor (constant-initialized, like EventQueue)
+        constexpr DeadlineQueue() :
+        mHeap{},
+        mNumEvents( 0 )
+        {
+        }
+
+        // Returns true if no events are in the queue
+        bool isEmpty();
+
+        // Returns true if no more events can be inserted into the queue
+        bool isFull();
+
+        // Actual number of events in queue
+        int getNumEvents();
+
+        // Tries to insert an event with an absolute deadline (in ticks) into the queue;
+        // Returns true if successful, false if the queue if full and the event cannot be inserted
+        // Like EventQueue::queueEvent(), this function can be called from interrupt handlers.
+        bool queueEvent( int eventCode, int eventParam, uint16_t deadline );
+
+        // Tries to extract the event with the earliest deadline from the queue;
+        // Returns true if successful, false if the queue is empty (the parameteres are not touched in this case)
+        bool popEvent( int* eventCode, int* eventParam );
+
+    private:
+
+        // Deadline queue size; same as the other event queues
+        // Increasing this number will consume 2 * sizeof(int) + 2 bytes of RAM for each unit.
+        static const int kEventQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE;
+
+        struct DeadlineElement
+        {
+            int         code;       // each event is represented by an integer code
+            int         param;      // each event has a single integer parameter
+            uint16_t    deadline;   // absolute deadline, in ticks
+        };
+
+        // True if a's deadline is earlier than b's (the tick counter is allowed to wrap)
+        static bool isEarlier( const DeadlineElement& a, const DeadlineElement& b );
+
+        // The heap
+        DeadlineElement mHeap[ kEventQueueSize ];
+
         // Actual number of events in queue
         int mNumEvents;
     };
 
+#endif
+
 
     // ListenerList class used internally by EventManager
     class ListenerList
@@ -106,26 +356,84 @@ namespace EventManager
     public:
 
         // Create an event manager
-        ListenerList();
+        // Dispatch table constructor (constant-initialized, like EventQueue), so listeners
+        // can safely be added from the constructors of other global objects
+        constexpr ListenerList() :
+        mNumListeners( 0 ),
+        mListeners{},
+        mDisabledGroups( 0 ),
+        mDispatchDepth( 0 ),
+        mTidyPending( false ),
+        mReuseLimit( kMaxListeners ),
+        mDefaultCallback( 0 ),
+        mDefaultCallbackEnabled( false )
+#if EVENTMANAGER_LISTENER_TABLES
+        ,
+        mTable( 0 ),
+        mTableSize( 0 ),
+        mTableInFlash( false )
+#endif
+        {
+        }
 
         // Add a listener
         // Returns true if the listener is successfully installed, false otherwise (e.g. the dispatch table is full)
-        bool addListener( int eventCode, EventListener listener );
+        bool addListener( int eventCode, EventListener listener, uint8_t group, int8_t priority );
+
+        // Add a listener that can consume events, stopping further dispatch
+        bool addConsumingListener( int eventCode, EventConsumer consumer, uint8_t group, int8_t priority );
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+        // Add a listener that is called once with a run of events with the same code
+        bool addBatchListener( int eventCode, EventBatchListener listener, uint8_t group, int8_t priority );
+
+        // Returns true if an enabled batch listener listens for eventCode
+        bool hasBatchListener( int eventCode );
+#endif
+
+        // Add a listener that is removed automatically after it is called once
+        bool addOneShotListener( int eventCode, EventListener listener, uint8_t group, int8_t priority );
+
+#if EVENTMANAGER_RANGE_LISTENERS
+        // Add a listener for all event codes in [loEventCode, hiEventCode]
+        bool addRangeListener( int loEventCode, int hiEventCode, EventListener listener, uint8_t group, int8_t priority );
+
+        // Add a listener for all event codes with ( eventCode & eventMask ) == eventValue
+        bool addMaskListener( int eventMask, int eventValue, EventListener listener, uint8_t group, int8_t priority );
+
+        // Remove a range or mask entry
+        bool removeRangeListener( int loEventCode, int hiEventCode, EventListener listener );
+        bool removeMaskListener( int eventMask, int eventValue, EventListener listener );
+#endif
 
         // Remove event listener pair (all occurrences)
         // Other listeners with the same function or eventCode will not be affected
         bool removeListener( int eventCode, EventListener listener );
+        bool removeListener( int eventCode, EventConsumer consumer );
 
         // Remove all occurrances of a listener
         // Removes this listener regardless of the eventCode; returns number removed
         int removeListener( EventListener listener );
+        int removeListener( EventConsumer consumer );
 
         // Enable or disable a listener
         // Return true if the listener was successfully enabled or disabled, false if the listener was not found
         bool enableListener( int eventCode, EventListener listener, bool enable );
+        bool enableListener( int eventCode, EventConsumer consumer, bool enable );
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+        bool removeListener( int eventCode, EventBatchListener listener );
+        int removeListener( EventBatchListener listener );
+        bool enableListener( int eventCode, EventBatchListener listener, bool enable );
+#endif
 
         bool isListenerEnabled( int eventCode, EventListener listener );
 
+        // Listener groups are enabled or disabled as a whole by a single bit in mDisabledGroups
+        void enableListenerGroup( uint8_t group, bool enable );
+        void setEnabledListenerGroups( uint8_t groupMask );
+        bool isListenerGroupEnabled( uint8_t group );
+
         // The default listener is a callback function that is called when an event with no listener is processed
         bool setDefaultListener( EventListener listener );
         void removeDefaultListener();
@@ -140,40 +448,161 @@ namespace EventManager
         // Send an event to the listeners; returns number of listeners that handled the event
         int sendEvent( int eventCode, int param );
 
+        // Send a run of count events with the same code to the listeners; returns number of
+        // listeners that handled the events.  Consumed events are removed from params.
+        int sendEvents( int eventCode, int* params, uint8_t count );
+
         int numListeners();
 
+#if EVENTMANAGER_LISTENER_TABLES
+        // Select the listener table consulted after the dispatch table
+        void setActiveTable( const ListenerTableEntry* table, uint8_t numEntries, bool inFlash );
+#endif
+
     private:
 
         // Maximum number of event/callback entries
         // Can be changed to save memory or allow more events to be dispatched
         static const int kMaxListeners = EVENTMANAGER_DISPATCH_TABLE_SIZE;
 
+        // Number of listener groups (one bit each in mDisabledGroups)
+        static const uint8_t kNumListenerGroups = 8;
+
         // Actual number of event listeners
         int mNumListeners;
 
+        // Flags of a dispatch table entry, packed into a single byte: how the event code is
+        // matched, what kind of callback the entry holds, whether it is disabled, and its group
+        enum ListenerFlags
+        {
+            kMatchExact         = 0x00,     // eventCode == code
+            kMatchRange         = 0x01,     // code <= eventCode <= aux
+            kMatchMask          = 0x02,     // ( eventCode & aux ) == code
+            kMatchTypeMask      = 0x03,
+
+            kKindListener       = 0x00,     // Callback is an EventListener
+            kKindOneShot        = 0x04,     // Callback is an EventListener, removed after its first dispatch
+            kKindConsumer       = 0x08,     // Callback is really an EventConsumer
+            kKindBatch          = 0x0C,     // Callback is really an EventBatchListener
+            kKindMask           = 0x0C,
+
+            kFlagDisabled       = 0x10,     // Entry has been disabled with enableListener()
+
+            kGroupShift         = 5,        // The top three bits hold the entry's listener group
+            kGroupMask          = 0xE0
+        };
+
+        // The function called by a dispatch table entry; the kind in the entry's flags tells
+        // which member is in use (entries with a null listener and kKindListener are retired)
+        union Callback
+        {
+            EventListener       listener;
+            EventConsumer       consumer;
+#if EVENTMANAGER_MAX_BATCH_SIZE
+            EventBatchListener  batch;
+#endif
+        };
+
         // Listener structure and corresponding array
         struct ListenerItem
         {
-            EventListener	callback;		// The listener function
-            int				eventCode;		// The event code
-            bool			enabled;			// Each listener can be enabled or disabled
+            Callback		callback;		// The listener function
+            int				eventCode;		// The event code (low end of a range, or value of a mask)
+#if EVENTMANAGER_RANGE_LISTENERS
+            int				eventCodeAux;	// High end of a range, or mask of a mask (unused for exact)
+#endif
+            uint8_t			flags;			// ListenerFlags
+#if EVENTMANAGER_LISTENER_PRIORITIES
+            int8_t			priority;		// Higher priority entries are dispatched first
+#endif
         };
         ListenerItem mListeners[ kMaxListeners ];
 
+        // One bit per listener group; entries in a disabled group are not called
+        // (stored inverted so that all groups are enabled when the table is zero-initialized)
+        uint8_t mDisabledGroups;
+
+        // Nesting depth of sendEvent(); entries are not shifted while this is non-zero
+        uint8_t mDispatchDepth;
+
+        // True if entries were retired or appended during dispatch and the table needs tidying
+        bool mTidyPending;
+
+        // During dispatch, the highest index of a retired entry that addEntry() may reuse
+        // (sendEvent() has already called the entries up to it)
+        int mReuseLimit;
+
         // Callback function to be called for event types which have no listener
         EventListener mDefaultCallback;
 
         // Once set, the default callback function can be enabled or disabled
         bool mDefaultCallbackEnabled;
 
+#if EVENTMANAGER_LISTENER_TABLES
+        // The active listener table (may be null), its size, and whether it is in flash
+        const ListenerTableEntry* mTable;
+        uint8_t mTableSize;
+        bool mTableInFlash;
+#endif
+
         // get the current number of entries in the dispatch table
         int getNumEntries();
 
+        // Does this dispatch table entry match eventCode?
+        static bool matches( const ListenerItem& item, int eventCode );
+
+        // Is this dispatch table entry live, enabled, and in an enabled group?
+        bool isActive( const ListenerItem& item );
+
+        // Is the entry at index k still active and calling callback?  (A listener may remove
+        // or disable itself, or its group, part way through a run of events.)
+        bool isStillActive( int k, uint8_t kind, const Callback& callback );
+
+        // Wrap a listener function as a Callback
+        static Callback makeCallback( EventListener listener );
+        static Callback makeCallback( EventConsumer consumer );
+#if EVENTMANAGER_MAX_BATCH_SIZE
+        static Callback makeCallback( EventBatchListener listener );
+#endif
+
+        // Is the callback of this kind non-null?
+        static bool hasCallback( uint8_t kind, const Callback& callback );
+
+        // Does this dispatch table entry call the callback of this kind?
+        // (one-shot entries count as kKindListener)
+        static bool isCallback( const ListenerItem& item, uint8_t kind, const Callback& callback );
+
+#if EVENTMANAGER_LISTENER_TABLES || EVENTMANAGER_SECTION_LISTENERS
+        // Call the listeners for eventCode in a listener table, once for each of count events;
+        // returns number of listeners called
+        static int sendToTable( const ListenerTableEntry* table, int numEntries, bool inFlash,
+                                int eventCode, const int* params, uint8_t count );
+#endif
+
+        // Common implementation of the various add, remove and enable functions
+        bool addEntry( uint8_t flags, int eventCode, int eventCodeAux, Callback callback, uint8_t group, int8_t priority );
+        bool removeEntry( uint8_t matchType, int eventCode, int eventCodeAux, uint8_t kind, Callback callback );
+        int removeEntries( uint8_t kind, Callback callback );
+        bool enableEntry( int eventCode, uint8_t kind, Callback callback, bool enable );
+
+        // Remove the entry at index k, shifting the following entries down
+        // (or, during dispatch, retiring it until the dispatch completes)
+        void removeEntryAt( int k );
+
+        // Mark the entry at index k as retired; it is squeezed out by tidy()
+        void retireEntryAt( int k );
+
+        // Squeeze out the entries retired during dispatch and restore priority order
+        void tidy();
+
         // returns the array index of the specified listener or -1 if no such event/function couple is found
-        int searchListeners( int eventCode, EventListener listener);
-        int searchListeners( EventListener listener );
+        int searchListeners( uint8_t matchType, int eventCode, int eventCodeAux, uint8_t kind, const Callback& callback );
+        int searchListeners( uint8_t kind, const Callback& callback );
         int searchEventCode( int eventCode );
 
+        // returns the array index of an entry retired during dispatch that may be reused, or -1
+        int searchRetiredEntry();
+
     };
 
 
@@ -182,118 +611,1308 @@ namespace EventManager
     EventQueue 	                mHighPriorityQueue;
     EventQueue 	                mLowPriorityQueue;
 
+#if EVENTMANAGER_BACKLOG_SIZE
+    // Low priority events already taken out of mLowPriorityQueue (always older than those still in it)
+    EventBacklog                mBacklog;
+#endif
+
     ListenerList		mListeners;
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+    DeadlineQueue               mDeadlineQueue;
+#endif
+
+    // User-provided source of the current time in ticks (may be null)
+    TickSource                  mTickSource;
+
+    // Current time in ticks (0 if there is no tick source)
+    uint16_t currentTick();
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    // Time-to-live of each event code in ticks (0 means events never expire)
+    uint16_t                    mEventTimeToLive[ EVENTMANAGER_NUM_EVENT_CODES ];
+
+    // Enqueue time of the event currently being dispatched
+    uint16_t                    mCurrentEventStamp;
+#endif
+
+#if EVENTMANAGER_DEFAULT_PRIORITIES
+    // Non-zero for event codes queued as high priority by default
+    // (a byte per code, so the lookup in queueEvent() is a single array index)
+    uint8_t                     mHighPriorityCodes[ EVENTMANAGER_NUM_EVENT_CODES ];
+#endif
+
+#if EVENTMANAGER_RATE_LIMITS
+    // Token bucket for each event code; a bucket with zero capacity means no limit
+    struct RateLimit
+    {
+        uint8_t     tokens;         // events that may still be queued before the next refill
+        uint8_t     capacity;       // maximum number of tokens (the allowed burst)
+        uint8_t     refill;         // tokens added by each call to refillEventRateLimits()
+    };
+
+    RateLimit                   mRateLimits[ EVENTMANAGER_NUM_EVENT_CODES ];
+
+    // Number of events of each code rejected by the rate limit
+    volatile uint16_t           mRateLimitRejects[ EVENTMANAGER_NUM_EVENT_CODES ];
+#endif
+
+    // Returns false if eventCode has exhausted its rate limit (in which case the event must be rejected)
+    bool passesRateLimit( int eventCode );
+
+    // Give back the token taken by passesRateLimit() for an event that wasn't queued after all
+    void refundRateLimit( int eventCode );
+
+#if EVENTMANAGER_EVENT_COUNTERS
+    // Counter-only event codes, and the number of events counted for each
+    uint8_t                     mCountedCodes[ kEventCodeBitSetSize ];
+    volatile uint16_t           mEventCounts[ EVENTMANAGER_NUM_EVENT_CODES ];
+#endif
+
+    // Returns true if eventCode is counter-only (in which case the event has been counted and must not be queued)
+    bool countEvent( int eventCode );
+
+    // Pop the next event from queue, discarding events that have outlived their time-to-live
+    bool popLiveEvent( EventQueue& queue, int* eventCode, int* eventParam );
+
+    // Pop the next low priority event (from the backlog, if there is one), discarding expired events
+    bool popLowPriorityEvent( int* eventCode, int* eventParam );
+
+    // Returns true if low priority events are waiting
+    bool hasLowPriorityEvents();
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    // Returns true if an event queued at stamp has outlived its time-to-live
+    bool isExpired( int eventCode, uint16_t stamp );
+
+    // Drop an event that has outlived its time-to-live instead of dispatching it
+    void discardExpiredEvent( int eventCode );
+#endif
+
+    // Low priority events are serviced at least once every mLowPriorityServiceRatio high priority
+    // events (0 means strict priority); mHighPriorityStreak counts high priority events
+    // dispatched while low priority events were waiting
+    uint8_t                     mLowPriorityServiceRatio;
+    uint8_t                     mHighPriorityStreak;
+
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+    // Registered event sources, the merge policy, and the next source to try when round-robin
+    EventSource*                mSources[ EVENTMANAGER_MAX_EVENT_SOURCES ];
+    uint8_t                     mNumSources;
+    uint8_t                     mNextSource;
+    EventSourcePolicy           mSourcePolicy;
+
+    // Pop the next event from the registered event sources according to the merge policy
+    bool popSourceEvent( int* eventCode, int* eventParam );
+#endif
+
+    // Pop the next event to be processed, choosing the queue according to the scheduling policy
+    bool popNextEvent( int* eventCode, int* eventParam, EventPriority* pri );
+
+    // Pop the next event queued below high priority: from the event sources first, then low priority
+    bool popSourceOrLowPriorityEvent( int* eventCode, int* eventParam );
+
+    // Send a popped event to the listeners; returns number of listeners that handled the event
+    int dispatchEvent( int eventCode, int eventParam );
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+    // Send a run of popped events with the same code to the listeners
+    int dispatchEvents( int eventCode, int* eventParams, uint8_t count );
+#endif
+
+#if EVENTMANAGER_NUM_JOINS
+    // Joins; a join with a zero mask is free
+    struct EventJoin
+    {
+        int                     firstCode;          // event code of bit 0 of mask
+        uint16_t                mask;               // awaited event codes
+        uint16_t                arrived;            // awaited event codes processed so far
+        int                     completionCode;
+        int                     completionParam;
+        EventPriority           completionPri;
+    };
+
+    EventJoin                   mJoins[ EVENTMANAGER_NUM_JOINS ];
+#endif
+
+    // Record the arrival of eventCode in the joins awaiting it, queuing completion events
+    void updateEventJoins( int eventCode );
+
+#if EVENTMANAGER_PAINT_SCHEDULER
+    // Bounding box of the regions invalidated since the last paint
+    int                         mDirtyX0;
+    int                         mDirtyY0;
+    int                         mDirtyX1;
+    int                         mDirtyY1;
+    volatile bool               mDirty;
+
+    // True from the time a kEventPaint is queued until it is dispatched
+    bool                        mPaintPending;
+
+    // Minimum ticks between paint events, and the time the last one was queued
+    uint16_t                    mPaintInterval;
+    uint16_t                    mLastPaintTick;
+#endif
+
+    // Queue a kEventPaint if the display is dirty and a frame interval has elapsed
+    void servicePaintScheduler();
+
+#if EVENTMANAGER_NUM_TIMERS
+    // Event timers; a timer with a zero period is one-shot
+    struct EventTimer
+    {
+        int         code;
+        int         param;
+        uint16_t    due;        // tick at which the timer expires
+        uint16_t    period;
+        bool        active;
+    };
+
+    EventTimer                  mTimers[ EVENTMANAGER_NUM_TIMERS ];
+
+    // Returns the index of the active timer for eventCode, or -1
+    int searchEventTimer( int eventCode );
+
+    // Ticks from now until the next timer expires; returns false if no timer is active
+    bool getNextTimerDelay( uint16_t now, uint16_t* ticks );
+#endif
+
+    // Queue the events of expired timers
+    void serviceEventTimers();
+
+#if EVENTMANAGER_IDLE_SLEEP
+    // Idle sleep setting and the sleep mode to use
+    bool                        mIdleSleep;
+    uint8_t                     mIdleSleepMode;
+
+    // Returns true if nothing can become ready to process without an interrupt
+    // (must be called with interrupts disabled)
+    bool isIdle();
+
+    // Sleep until the next interrupt if there is nothing to do
+    void idleSleep();
+
+#if EVENTMANAGER_NUM_TIMERS
+    // Called before sleeping to program a wakeup at the next timer expiry
+    TicklessWakeupHook          mTicklessWakeupHook;
+#endif
+#endif
 };
 
 
 
-bool EventManager::addListener( int eventCode, EventListener listener )
+bool EventManager::addListener( int eventCode, EventListener listener, uint8_t group, int8_t priority )
 {
-    return mListeners.addListener( eventCode, listener );
+    return mListeners.addListener( eventCode, listener, group, priority );
 }
 
 
-bool EventManager::removeListener( int eventCode, EventListener listener )
+#if EVENTMANAGER_RANGE_LISTENERS
+
+bool EventManager::addRangeListener( int loEventCode, int hiEventCode, EventListener listener, uint8_t group, int8_t priority )
 {
-    return mListeners.removeListener( eventCode, listener );
+    return mListeners.addRangeListener( loEventCode, hiEventCode, listener, group, priority );
 }
 
 
-int EventManager::removeListener( EventListener listener )
+bool EventManager::removeRangeListener( int loEventCode, int hiEventCode, EventListener listener )
 {
-    return mListeners.removeListener( listener );
+    return mListeners.removeRangeListener( loEventCode, hiEventCode, listener );
 }
 
 
-bool EventManager::enableListener( int eventCode, EventListener listener, bool enable )
+bool EventManager::addMaskListener( int eventMask, int eventValue, EventListener listener, uint8_t group, int8_t priority )
 {
-    return mListeners.enableListener( eventCode, listener, enable );
+    return mListeners.addMaskListener( eventMask, eventValue, listener, group, priority );
 }
 
 
-bool EventManager::isListenerEnabled( int eventCode, EventListener listener )
+bool EventManager::removeMaskListener( int eventMask, int eventValue, EventListener listener )
 {
-    return mListeners.isListenerEnabled( eventCode, listener );
+    return mListeners.removeMaskListener( eventMask, eventValue, listener );
 }
 
+#endif
+
 
-bool EventManager::setDefaultListener( EventListener listener )
+bool EventManager::addConsumingListener( int eventCode, EventConsumer consumer, uint8_t group, int8_t priority )
 {
-    return mListeners.setDefaultListener( listener );
+    return mListeners.addConsumingListener( eventCode, consumer, group, priority );
 }
 
 
-void EventManager::removeDefaultListener()
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+bool EventManager::addBatchListener( int eventCode, EventBatchListener listener, uint8_t group, int8_t priority )
 {
-    mListeners.removeDefaultListener();
+    return mListeners.addBatchListener( eventCode, listener, group, priority );
 }
 
 
-void EventManager::enableDefaultListener( bool enable )
+bool EventManager::removeListener( int eventCode, EventBatchListener listener )
 {
-    mListeners.enableDefaultListener( enable );
+    return mListeners.removeListener( eventCode, listener );
 }
 
 
-bool EventManager::isListenerListEmpty()
+int EventManager::removeListener( EventBatchListener listener )
 {
-    return mListeners.isEmpty();
+    return mListeners.removeListener( listener );
 }
 
 
-bool EventManager::isListenerListFull()
+bool EventManager::enableListener( int eventCode, EventBatchListener listener, bool enable )
 {
-    return mListeners.isFull();
+    return mListeners.enableListener( eventCode, listener, enable );
 }
 
+#endif
+
 
-bool EventManager::isEventQueueEmpty( EventPriority pri )
+bool EventManager::addOneShotListener( int eventCode, EventListener listener, uint8_t group, int8_t priority )
 {
-    return ( pri == kHighPriority ) ? mHighPriorityQueue.isEmpty() : mLowPriorityQueue.isEmpty();
+    return mListeners.addOneShotListener( eventCode, listener, group, priority );
+}
+
+
+bool EventManager::removeListener( int eventCode, EventListener listener )
+{
+    return mListeners.removeListener( eventCode, listener );
+}
+
+
+bool EventManager::removeListener( int eventCode, EventConsumer consumer )
+{
+    return mListeners.removeListener( eventCode, consumer );
+}
+
+
+int EventManager::removeListener( EventListener listener )
+{
+    return mListeners.removeListener( listener );
+}
+
+
+int EventManager::removeListener( EventConsumer consumer )
+{
+    return mListeners.removeListener( consumer );
+}
+
+
+bool EventManager::enableListener( int eventCode, EventListener listener, bool enable )
+{
+    return mListeners.enableListener( eventCode, listener, enable );
+}
+
+
+bool EventManager::enableListener( int eventCode, EventConsumer consumer, bool enable )
+{
+    return mListeners.enableListener( eventCode, consumer, enable );
+}
+
+
+bool EventManager::isListenerEnabled( int eventCode, EventListener listener )
+{
+    return mListeners.isListenerEnabled( eventCode, listener );
+}
+
+
+void EventManager::enableListenerGroup( uint8_t group, bool enable )
+{
+    mListeners.enableListenerGroup( group, enable );
+}
+
+
+void EventManager::setEnabledListenerGroups( uint8_t groupMask )
+{
+    mListeners.setEnabledListenerGroups( groupMask );
+}
+
+
+bool EventManager::isListenerGroupEnabled( uint8_t group )
+{
+    return mListeners.isListenerGroupEnabled( group );
+}
+
+
+#if EVENTMANAGER_LISTENER_TABLES
+
+void EventManager::setActiveListenerTable( const ListenerTableEntry* table, uint8_t numEntries, bool inFlash )
+{
+    mListeners.setActiveTable( table, numEntries, inFlash );
+}
+
+
+void EventManager::ListenerList::setActiveTable( const ListenerTableEntry* table, uint8_t numEntries, bool inFlash )
+{
+    // Listener tables may be swapped from an interrupt handler; sendEvent() reads all three
+    // fields in an atomic block too, so it never sees a mixture of the old and new tables
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        mTable = table;
+        mTableSize = table ? numEntries : 0;
+        mTableInFlash = inFlash;
+    }
+    // ATOMIC BLOCK END
+}
+
+#endif
+
+
+bool EventManager::setDefaultListener( EventListener listener )
+{
+    return mListeners.setDefaultListener( listener );
+}
+
+
+void EventManager::removeDefaultListener()
+{
+    mListeners.removeDefaultListener();
+}
+
+
+void EventManager::enableDefaultListener( bool enable )
+{
+    mListeners.enableDefaultListener( enable );
+}
+
+
+bool EventManager::isListenerListEmpty()
+{
+    return mListeners.isEmpty();
+}
+
+
+bool EventManager::isListenerListFull()
+{
+    return mListeners.isFull();
+}
+
+
+bool EventManager::isEventQueueEmpty( EventPriority pri )
+{
+    return ( pri == kHighPriority ) ? mHighPriorityQueue.isEmpty() : !hasLowPriorityEvents();
 }
 
 
 bool EventManager::isEventQueueFull( EventPriority pri )
 {
-    return ( pri == kHighPriority ) ? mHighPriorityQueue.isFull() : mLowPriorityQueue.isFull();
+    return ( pri == kHighPriority ) ? mHighPriorityQueue.isFull() : mLowPriorityQueue.isFull();
+}
+
+
+void EventManager::setTickSource( TickSource source )
+{
+    mTickSource = source;
+}
+
+
+uint16_t EventManager::currentTick()
+{
+    return mTickSource ? (*mTickSource)() : 0;
+}
+
+
+#if EVENTMANAGER_NUM_TIMERS
+
+bool EventManager::setEventTimer( int eventCode, int eventParam, uint16_t delay, uint16_t period )
+{
+    int k = searchEventTimer( eventCode );
+    if ( k < 0 )
+    {
+        k = searchEventTimer( kEventNone );
+        if ( k < 0 )
+        {
+            return false;
+        }
+    }
+
+    mTimers[ k ].code = eventCode;
+    mTimers[ k ].param = eventParam;
+    mTimers[ k ].due = currentTick() + delay;
+    mTimers[ k ].period = period;
+    mTimers[ k ].active = true;
+    return true;
+}
+
+
+bool EventManager::cancelEventTimer( int eventCode )
+{
+    int k = searchEventTimer( eventCode );
+    if ( k < 0 )
+    {
+        return false;
+    }
+
+    mTimers[ k ].active = false;
+    return true;
+}
+
+
+int EventManager::searchEventTimer( int eventCode )
+{
+    // kEventNone finds a free timer
+    for ( int k = 0; k < EVENTMANAGER_NUM_TIMERS; k++ )
+    {
+        if ( eventCode == kEventNone ? !mTimers[ k ].active : ( mTimers[ k ].active && mTimers[ k ].code == eventCode ) )
+        {
+            return k;
+        }
+    }
+
+    return -1;
+}
+
+
+bool EventManager::getNextTimerDelay( uint16_t now, uint16_t* ticks )
+{
+    bool found = false;
+    for ( int k = 0; k < EVENTMANAGER_NUM_TIMERS; k++ )
+    {
+        if ( mTimers[ k ].active )
+        {
+            int16_t left = static_cast<int16_t>( mTimers[ k ].due - now );
+            uint16_t delay = ( left > 0 ) ? left : 0;
+            if ( !found || delay < *ticks )
+            {
+                *ticks = delay;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+#endif
+
+
+void EventManager::serviceEventTimers()
+{
+#if EVENTMANAGER_NUM_TIMERS
+    uint16_t now = currentTick();
+    for ( int k = 0; k < EVENTMANAGER_NUM_TIMERS; k++ )
+    {
+        EventTimer& t = mTimers[ k ];
+        if ( t.active && static_cast<int16_t>( now - t.due ) >= 0
+            && mLowPriorityQueue.queueEvent( t.code, t.param ) )
+        {
+            if ( t.period )
+            {
+                // Stay in phase, but don't try to make up for periods missed altogether
+                t.due += t.period;
+                if ( static_cast<int16_t>( now - t.due ) >= 0 )
+                {
+                    t.due = now + t.period;
+                }
+            }
+            else
+            {
+                t.active = false;
+            }
+        }
+    }
+#endif
+}
+
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+
+bool EventManager::queueEventWithDeadline( int eventCode, int eventParam, uint16_t deadline )
+{
+    if ( countEvent( eventCode ) )
+    {
+        return true;
+    }
+
+    if ( !passesRateLimit( eventCode ) )
+    {
+        return false;
+    }
+
+    if ( !mDeadlineQueue.queueEvent( eventCode, eventParam, currentTick() + deadline ) )
+    {
+        refundRateLimit( eventCode );
+        return false;
+    }
+
+    return true;
+}
+
+
+int EventManager::getNumEventsInDeadlineQueue()
+{
+    return mDeadlineQueue.getNumEvents();
+}
+
+#endif
+
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+
+bool EventManager::setEventTimeToLive( int eventCode, uint16_t ttl )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return false;
+    }
+
+    mEventTimeToLive[ eventCode ] = ttl;
+    return true;
+}
+
+
+uint16_t EventManager::getEventAge()
+{
+    return currentTick() - mCurrentEventStamp;
+}
+
+#endif
+
+
+#if EVENTMANAGER_RATE_LIMITS
+
+bool EventManager::setEventRateLimit( int eventCode, uint8_t refill, uint8_t burst )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return false;
+    }
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        mRateLimits[ eventCode ].tokens = burst;
+        mRateLimits[ eventCode ].capacity = burst;
+        mRateLimits[ eventCode ].refill = refill;
+    }
+    return true;
+}
+
+
+void EventManager::refillEventRateLimits()
+{
+    // Interrupts are disabled for each bucket separately to keep the interrupt latency short
+    for ( int i = 0; i < EVENTMANAGER_NUM_EVENT_CODES; i++ )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            RateLimit& r = mRateLimits[ i ];
+            if ( r.tokens < r.capacity )
+            {
+                r.tokens = ( r.capacity - r.tokens > r.refill ) ? r.tokens + r.refill : r.capacity;
+            }
+        }
+    }
+}
+
+
+uint16_t EventManager::getNumRateLimitedEvents( int eventCode )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return 0;
+    }
+
+    uint16_t n;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        n = mRateLimitRejects[ eventCode ];
+    }
+    return n;
+}
+
+
+void EventManager::clearNumRateLimitedEvents()
+{
+    for ( int i = 0; i < EVENTMANAGER_NUM_EVENT_CODES; i++ )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            mRateLimitRejects[ i ] = 0;
+        }
+    }
+}
+
+#endif
+
+
+bool EventManager::countEvent( int eventCode )
+{
+#if EVENTMANAGER_EVENT_COUNTERS
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES || !isBitSet( mCountedCodes, eventCode ) )
+    {
+        return false;
+    }
+
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( mEventCounts[ eventCode ] != 0xFFFF )
+        {
+            mEventCounts[ eventCode ]++;
+        }
+    }
+    // ATOMIC BLOCK END
+
+    return true;
+#else
+    (void) eventCode;
+    return false;
+#endif
+}
+
+
+#if EVENTMANAGER_EVENT_COUNTERS
+
+bool EventManager::enableEventCounter( int eventCode, bool enable )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return false;
+    }
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( enable )
+        {
+            setBit( mCountedCodes, eventCode );
+        }
+        else
+        {
+            clearBit( mCountedCodes, eventCode );
+        }
+    }
+    return true;
+}
+
+
+uint16_t EventManager::readAndClearEventCount( int eventCode )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return 0;
+    }
+
+    uint16_t count;
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        count = mEventCounts[ eventCode ];
+        mEventCounts[ eventCode ] = 0;
+    }
+    // ATOMIC BLOCK END
+
+    return count;
+}
+
+
+bool EventManager::postEventCount( int eventCode, EventPriority pri )
+{
+    uint16_t count = readAndClearEventCount( eventCode );
+    if ( !count )
+    {
+        return false;
+    }
+
+    // Queue directly, bypassing the counter (and the rate limit)
+    EventQueue& queue = ( pri == kHighPriority ) ? mHighPriorityQueue : mLowPriorityQueue;
+    if ( !queue.queueEvent( eventCode, static_cast<int>( count ) ) )
+    {
+        // Put the count back, along with anything counted meanwhile
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            uint16_t total = mEventCounts[ eventCode ] + count;
+            mEventCounts[ eventCode ] = ( total < count ) ? 0xFFFF : total;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+#endif
+
+
+bool EventManager::passesRateLimit( int eventCode )
+{
+#if EVENTMANAGER_RATE_LIMITS
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return true;
+    }
+
+    bool retVal = true;
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        RateLimit& r = mRateLimits[ eventCode ];
+        if ( r.capacity )
+        {
+            if ( r.tokens )
+            {
+                r.tokens--;
+            }
+            else
+            {
+                if ( mRateLimitRejects[ eventCode ] != 0xFFFF )
+                {
+                    mRateLimitRejects[ eventCode ]++;
+                }
+                retVal = false;
+            }
+        }
+    }
+    // ATOMIC BLOCK END
+
+    return retVal;
+#else
+    (void) eventCode;
+    return true;
+#endif
+}
+
+
+void EventManager::refundRateLimit( int eventCode )
+{
+#if EVENTMANAGER_RATE_LIMITS
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return;
+    }
+
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        RateLimit& r = mRateLimits[ eventCode ];
+        if ( r.tokens < r.capacity )
+        {
+            r.tokens++;
+        }
+    }
+    // ATOMIC BLOCK END
+#else
+    (void) eventCode;
+#endif
+}
+
+
+#if EVENTMANAGER_DEDUPLICATION
+
+bool EventManager::enableEventDeduplication( int eventCode, bool enable )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return false;
+    }
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( enable )
+        {
+            setBit( mDeduplicatedCodes, eventCode );
+        }
+        else
+        {
+            clearBit( mDeduplicatedCodes, eventCode );
+        }
+    }
+    return true;
+}
+
+#endif
+
+
+#if EVENTMANAGER_PAINT_SCHEDULER
+
+void EventManager::invalidateRegion( int x0, int y0, int x1, int y1 )
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( !mDirty )
+        {
+            mDirtyX0 = x0;
+            mDirtyY0 = y0;
+            mDirtyX1 = x1;
+            mDirtyY1 = y1;
+            mDirty = true;
+        }
+        else
+        {
+            // Grow the bounding box to cover the new region
+            if ( x0 < mDirtyX0 )
+            {
+                mDirtyX0 = x0;
+            }
+            if ( y0 < mDirtyY0 )
+            {
+                mDirtyY0 = y0;
+            }
+            if ( x1 > mDirtyX1 )
+            {
+                mDirtyX1 = x1;
+            }
+            if ( y1 > mDirtyY1 )
+            {
+                mDirtyY1 = y1;
+            }
+        }
+    }
+}
+
+
+bool EventManager::getPaintRegion( int* x0, int* y0, int* x1, int* y1 )
+{
+    bool retVal = false;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( mDirty )
+        {
+            *x0 = mDirtyX0;
+            *y0 = mDirtyY0;
+            *x1 = mDirtyX1;
+            *y1 = mDirtyY1;
+            mDirty = false;
+            retVal = true;
+        }
+    }
+    return retVal;
+}
+
+
+void EventManager::setPaintInterval( uint16_t ticks )
+{
+    mPaintInterval = ticks;
+}
+
+#endif
+
+
+void EventManager::servicePaintScheduler()
+{
+#if EVENTMANAGER_PAINT_SCHEDULER
+    if ( mDirty && !mPaintPending )
+    {
+        uint16_t now = currentTick();
+        if ( static_cast<uint16_t>( now - mLastPaintTick ) >= mPaintInterval
+            && mLowPriorityQueue.queueEvent( kEventPaint, 0 ) )
+        {
+            mPaintPending = true;
+            mLastPaintTick = now;
+        }
+    }
+#endif
+}
+
+
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+
+bool EventManager::addEventSource( EventSource* source )
+{
+    if ( !source || mNumSources == EVENTMANAGER_MAX_EVENT_SOURCES )
+    {
+        return false;
+    }
+
+    mSources[ mNumSources++ ] = source;
+    return true;
+}
+
+
+bool EventManager::removeEventSource( EventSource* source )
+{
+    for ( uint8_t i = 0; i < mNumSources; i++ )
+    {
+        if ( mSources[ i ] == source )
+        {
+            for ( uint8_t k = i; k < mNumSources - 1; k++ )
+            {
+                mSources[ k ] = mSources[ k + 1 ];
+            }
+            mNumSources--;
+            mNextSource = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void EventManager::setEventSourcePolicy( EventSourcePolicy policy )
+{
+    mSourcePolicy = policy;
+    mNextSource = 0;
+}
+
+
+bool EventManager::popSourceEvent( int* eventCode, int* eventParam )
+{
+    uint8_t k = ( mSourcePolicy == kSourceRoundRobin ) ? mNextSource : 0;
+    for ( uint8_t n = 0; n < mNumSources; n++ )
+    {
+        if ( k >= mNumSources )
+        {
+            k = 0;
+        }
+
+        if ( mSources[ k ]->popEvent( eventCode, eventParam ) )
+        {
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+            // Source events aren't timestamped; they are never stale
+            mCurrentEventStamp = currentTick();
+#endif
+            mNextSource = k + 1;
+            return true;
+        }
+
+        k++;
+    }
+
+    return false;
+}
+
+
+bool EventManager::EventSource::popEvent( int* eventCode, int* eventParam )
+{
+    // Single consumer: only this function writes mHead
+    uint8_t head = mHead;
+    if ( head == mTail )
+    {
+        return false;
+    }
+
+    // Don't read the event before seeing that the producer has published it
+    __asm__ __volatile__ ( "" ::: "memory" );
+    *eventCode = mEvents[ head ].code;
+    *eventParam = mEvents[ head ].param;
+
+    // Release the slot only after the event has been read out of it
+    __asm__ __volatile__ ( "" ::: "memory" );
+    mHead = nextIndex( head );
+
+    return true;
+}
+
+#endif
+
+
+#if EVENTMANAGER_IDLE_SLEEP
+
+void EventManager::enableIdleSleep( bool enable, uint8_t sleepMode )
+{
+    mIdleSleep = enable;
+    mIdleSleepMode = sleepMode;
+}
+
+
+#if EVENTMANAGER_NUM_TIMERS
+
+void EventManager::setTicklessWakeupHook( TicklessWakeupHook hook )
+{
+    mTicklessWakeupHook = hook;
+}
+
+#endif
+
+
+bool EventManager::isIdle()
+{
+    if ( !mHighPriorityQueue.isEmpty() || hasLowPriorityEvents() )
+    {
+        return false;
+    }
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+    if ( !mDeadlineQueue.isEmpty() )
+    {
+        return false;
+    }
+#endif
+
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+    for ( uint8_t k = 0; k < mNumSources; k++ )
+    {
+        if ( !mSources[ k ]->isEmpty() )
+        {
+            return false;
+        }
+    }
+#endif
+
+#if EVENTMANAGER_PAINT_SCHEDULER
+    // A paint waiting for its frame interval is only noticed by polling
+    if ( mDirty && !mPaintPending )
+    {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+
+void EventManager::idleSleep()
+{
+    if ( !mIdleSleep )
+    {
+        return;
+    }
+
+#if EVENTMANAGER_NUM_TIMERS
+    // Read the time before disabling interrupts (the tick source may itself need interrupts)
+    uint16_t ticks = 0;
+    if ( !getNextTimerDelay( currentTick(), &ticks ) )
+    {
+        ticks = 0;
+    }
+    else if ( !ticks )
+    {
+        // A timer has expired; its event will be queued on the next pass
+        return;
+    }
+#endif
+
+    set_sleep_mode( mIdleSleepMode );
+
+    /*
+    * An interrupt that queues an event after the emptiness check but before sleep_cpu()
+    * would leave the event waiting until some other interrupt wakes us.  So check with
+    * interrupts disabled, and enable them only immediately before sleeping: the instruction
+    * following sei is always executed before any pending interrupt is serviced, so such an
+    * interrupt will wake the processor from sleep_cpu() rather than run before it.
+    */
+
+    cli();
+    if ( isIdle() )
+    {
+#if EVENTMANAGER_NUM_TIMERS
+        if ( mTicklessWakeupHook )
+        {
+            (*mTicklessWakeupHook)( ticks );
+        }
+#endif
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    sei();
+}
+
+#endif
+
+
+void EventManager::setLowPriorityServiceRatio( uint8_t ratio )
+{
+    mLowPriorityServiceRatio = ratio;
+    mHighPriorityStreak = 0;
+}
+
+
+int EventManager::getNumEventsInQueue( EventPriority pri )
+{
+    if ( pri == kHighPriority )
+    {
+        return mHighPriorityQueue.getNumEvents();
+    }
+
+#if EVENTMANAGER_BACKLOG_SIZE
+    return mLowPriorityQueue.getNumEvents() + mBacklog.getNumEvents();
+#else
+    return mLowPriorityQueue.getNumEvents();
+#endif
+}
+
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+
+bool EventManager::setEventQueueWatermarks( EventPriority pri, uint8_t highWatermark, uint8_t lowWatermark,
+                                            QueueWatermarkCallback callback )
+{
+    return ( pri == kHighPriority ) ?
+        mHighPriorityQueue.setWatermarks( highWatermark, lowWatermark, callback ) :
+        mLowPriorityQueue.setWatermarks( highWatermark, lowWatermark, callback );
+}
+
+#endif
+
+
+bool EventManager::queueEvent( int eventCode, int eventParam, EventPriority pri )
+{
+    if ( countEvent( eventCode ) )
+    {
+        return true;
+    }
+
+    if ( !passesRateLimit( eventCode ) )
+    {
+        return false;
+    }
+
+    bool merged = false;
+    EventQueue& queue = ( pri == kHighPriority ) ? mHighPriorityQueue : mLowPriorityQueue;
+    bool queued = queue.queueEvent( eventCode, eventParam, &merged );
+    if ( !queued || merged )
+    {
+        // The event took no room in the queue (it was rejected, or merged with an identical
+        // pending event), so it doesn't count against the rate limit
+        refundRateLimit( eventCode );
+    }
+
+    return queued;
+}
+
+
+bool EventManager::queueEvent( int eventCode, int eventParam )
+{
+#if EVENTMANAGER_DEFAULT_PRIORITIES
+    return queueEvent( eventCode, eventParam, getDefaultEventPriority( eventCode ) );
+#else
+    return queueEvent( eventCode, eventParam, kLowPriority );
+#endif
+}
+
+
+#if EVENTMANAGER_DEFAULT_PRIORITIES
+
+bool EventManager::setDefaultEventPriority( int eventCode, EventPriority pri )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES )
+    {
+        return false;
+    }
+
+    mHighPriorityCodes[ eventCode ] = ( pri == kHighPriority );
+    return true;
+}
+
+
+EventManager::EventPriority EventManager::getDefaultEventPriority( int eventCode )
+{
+    // Cast to unsigned so that negative event codes are out of range too
+    return ( static_cast<unsigned>( eventCode ) < EVENTMANAGER_NUM_EVENT_CODES && mHighPriorityCodes[ eventCode ] ) ?
+        kHighPriority : kLowPriority;
+}
+
+#endif
+
+
+
+
+//*********  INLINES   EventManager::EventQueue::  ***********
+
+inline bool EventManager::EventQueue::isEmpty()
+{
+    return ( mNumEvents == 0 );
+}
+
+
+inline bool EventManager::EventQueue::isFull()
+{
+    return ( mNumEvents == kEventQueueSize );
+}
+
+
+inline int EventManager::EventQueue::getNumEvents()
+{
+    return mNumEvents;
 }
 
 
-int EventManager::getNumEventsInQueue( EventPriority pri )
+inline int EventManager::EventQueue::nextIndex( int i )
 {
-    return ( pri == kHighPriority ) ? mHighPriorityQueue.getNumEvents() : mLowPriorityQueue.getNumEvents();
+    // Cheaper than % on an AVR
+    return ( i + 1 < kEventQueueSize ) ? i + 1 : 0;
 }
 
 
-bool EventManager::queueEvent( int eventCode, int eventParam, EventPriority pri )
+inline void EventManager::EventQueue::storeEvent( int slot, int eventCode, int eventParam, uint16_t stamp )
 {
-    return ( pri == kHighPriority ) ?
-        mHighPriorityQueue.queueEvent( eventCode, eventParam ) : mLowPriorityQueue.queueEvent( eventCode, eventParam );
+    mEventQueue[ slot ].code = eventCode;
+    mEventQueue[ slot ].param = eventParam;
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    mEventQueue[ slot ].stamp = stamp;
+#else
+    (void) stamp;
+#endif
+}
+
+
+inline void EventManager::EventQueue::loadEvent( int slot, int* eventCode, int* eventParam, uint16_t* timestamp )
+{
+    *eventCode  = mEventQueue[ slot ].code;
+    *eventParam = mEventQueue[ slot ].param;
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    if ( timestamp )
+    {
+        *timestamp = mEventQueue[ slot ].stamp;
+    }
+#else
+    (void) timestamp;
+#endif
+
+    // Clear the event (paranoia)
+    mEventQueue[ slot ].code = EventManager::kEventNone;
 }
 
 
 
+#if EVENTMANAGER_BACKLOG_SIZE
 
-//*********  INLINES   EventManager::EventQueue::  ***********
+//*********  INLINES   EventManager::EventBacklog::  ***********
 
-inline bool EventManager::EventQueue::isEmpty()
+inline bool EventManager::EventBacklog::isEmpty()
 {
     return ( mNumEvents == 0 );
 }
 
 
-inline bool EventManager::EventQueue::isFull()
+inline bool EventManager::EventBacklog::isFull()
+{
+    return ( mNumEvents == kBacklogSize );
+}
+
+
+inline int EventManager::EventBacklog::getNumEvents()
+{
+    return mNumEvents;
+}
+
+#endif
+
+
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+
+//*********  INLINES   EventManager::DeadlineQueue::  ***********
+
+inline bool EventManager::DeadlineQueue::isEmpty()
+{
+    return ( mNumEvents == 0 );
+}
+
+
+inline bool EventManager::DeadlineQueue::isFull()
 {
     return ( mNumEvents == kEventQueueSize );
 }
 
 
-inline int EventManager::EventQueue::getNumEvents()
+inline int EventManager::DeadlineQueue::getNumEvents()
 {
     return mNumEvents;
 }
 
 
+inline bool EventManager::DeadlineQueue::isEarlier( const DeadlineElement& a, const DeadlineElement& b )
+{
+    return static_cast<int16_t>( a.deadline - b.deadline ) < 0;
+}
+
+#endif
+
+
 
 //*********  INLINES   EventManager::ListenerList::  ***********
 
@@ -312,6 +1931,108 @@ inline int EventManager::ListenerList::getNumEntries()
     return mNumListeners;
 }
 
+inline bool EventManager::ListenerList::matches( const ListenerItem& item, int eventCode )
+{
+#if EVENTMANAGER_RANGE_LISTENERS
+    uint8_t matchType = item.flags & kMatchTypeMask;
+
+    if ( matchType == kMatchExact )
+    {
+        return item.eventCode == eventCode;
+    }
+    else if ( matchType == kMatchRange )
+    {
+        return ( eventCode >= item.eventCode ) && ( eventCode <= item.eventCodeAux );
+    }
+    else
+    {
+        return ( eventCode & item.eventCodeAux ) == item.eventCode;
+    }
+#else
+    return item.eventCode == eventCode;
+#endif
+}
+
+inline bool EventManager::ListenerList::isActive( const ListenerItem& item )
+{
+    return hasCallback( item.flags & kKindMask, item.callback ) && !( item.flags & kFlagDisabled )
+        && !( ( 1 << ( item.flags >> kGroupShift ) ) & mDisabledGroups );
+}
+
+inline bool EventManager::ListenerList::isStillActive( int k, uint8_t kind, const Callback& callback )
+{
+    return isActive( mListeners[ k ] ) && isCallback( mListeners[ k ], kind, callback );
+}
+
+inline EventManager::ListenerList::Callback EventManager::ListenerList::makeCallback( EventListener listener )
+{
+    Callback callback;
+    callback.listener = listener;
+    return callback;
+}
+
+inline EventManager::ListenerList::Callback EventManager::ListenerList::makeCallback( EventConsumer consumer )
+{
+    Callback callback;
+    callback.consumer = consumer;
+    return callback;
+}
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+inline EventManager::ListenerList::Callback EventManager::ListenerList::makeCallback( EventBatchListener listener )
+{
+    Callback callback;
+    callback.batch = listener;
+    return callback;
+}
+#endif
+
+inline bool EventManager::ListenerList::hasCallback( uint8_t kind, const Callback& callback )
+{
+    if ( kind == kKindConsumer )
+    {
+        return callback.consumer != 0;
+    }
+#if EVENTMANAGER_MAX_BATCH_SIZE
+    else if ( kind == kKindBatch )
+    {
+        return callback.batch != 0;
+    }
+#endif
+    else
+    {
+        return callback.listener != 0;
+    }
+}
+
+inline bool EventManager::ListenerList::isCallback( const ListenerItem& item, uint8_t kind, const Callback& callback )
+{
+    uint8_t itemKind = item.flags & kKindMask;
+    if ( itemKind == kKindOneShot )
+    {
+        itemKind = kKindListener;
+    }
+
+    if ( itemKind != kind )
+    {
+        return false;
+    }
+    else if ( kind == kKindConsumer )
+    {
+        return item.callback.consumer == callback.consumer;
+    }
+#if EVENTMANAGER_MAX_BATCH_SIZE
+    else if ( kind == kKindBatch )
+    {
+        return item.callback.batch == callback.batch;
+    }
+#endif
+    else
+    {
+        return item.callback.listener == callback.listener;
+    }
+}
+
 
 
 
@@ -334,29 +2055,308 @@ inline int EventManager::ListenerList::getNumEntries()
 
 
 
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+
+bool EventManager::isExpired( int eventCode, uint16_t stamp )
+{
+    uint16_t ttl = ( eventCode >= 0 && eventCode < EVENTMANAGER_NUM_EVENT_CODES ) ? mEventTimeToLive[ eventCode ] : 0;
+    return ttl && static_cast<uint16_t>( currentTick() - stamp ) > ttl;
+}
+
+
+void EventManager::discardExpiredEvent( int eventCode )
+{
+    EVTMGR_DEBUG_PRINT( "discarded expired event " )
+    EVTMGR_DEBUG_PRINTLN( eventCode )
+
+#if EVENTMANAGER_PAINT_SCHEDULER
+    if ( eventCode == kEventPaint )
+    {
+        // The scheduled paint is gone, so further invalidations must schedule a new one
+        mPaintPending = false;
+    }
+#else
+    (void) eventCode;
+#endif
+}
+
+#endif
+
+
+bool EventManager::popLiveEvent( EventQueue& queue, int* eventCode, int* eventParam )
+{
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    uint16_t stamp;
+    while ( queue.popEvent( eventCode, eventParam, &stamp ) )
+    {
+        if ( !isExpired( *eventCode, stamp ) )
+        {
+            mCurrentEventStamp = stamp;
+            return true;
+        }
+
+        discardExpiredEvent( *eventCode );
+    }
+    return false;
+#else
+    return queue.popEvent( eventCode, eventParam );
+#endif
+}
+
+
+bool EventManager::popLowPriorityEvent( int* eventCode, int* eventParam )
+{
+#if EVENTMANAGER_BACKLOG_SIZE
+    // Top up the backlog first; events still in the queue are newer than any in the backlog
+    mBacklog.spill( mLowPriorityQueue );
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    uint16_t stamp;
+    while ( mBacklog.popEvent( eventCode, eventParam, &stamp ) )
+    {
+        if ( !isExpired( *eventCode, stamp ) )
+        {
+            mCurrentEventStamp = stamp;
+            return true;
+        }
+
+        discardExpiredEvent( *eventCode );
+    }
+    return false;
+#else
+    return mBacklog.popEvent( eventCode, eventParam );
+#endif
+
+#else
+    return popLiveEvent( mLowPriorityQueue, eventCode, eventParam );
+#endif
+}
+
+
+bool EventManager::hasLowPriorityEvents()
+{
+#if EVENTMANAGER_BACKLOG_SIZE
+    return !mBacklog.isEmpty() || !mLowPriorityQueue.isEmpty();
+#else
+    return !mLowPriorityQueue.isEmpty();
+#endif
+}
+
+
+bool EventManager::popNextEvent( int* eventCode, int* eventParam, EventPriority* pri )
+{
+#if EVENTMANAGER_BACKLOG_SIZE
+    // Drain the interrupt-facing queue in bulk on every pass, so that producers rarely find it
+    // full even while a run of high priority events is being processed
+    mBacklog.spill( mLowPriorityQueue );
+#endif
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+    // Events with deadlines are more urgent than any fixed-priority event
+    // (they are reported as high priority)
+    if ( mDeadlineQueue.popEvent( eventCode, eventParam ) )
+    {
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+        // Deadline events aren't timestamped; they are never stale
+        mCurrentEventStamp = currentTick();
+#endif
+        *pri = kHighPriority;
+        return true;
+    }
+#endif
+
+    // If low priority events have waited through enough high priority events, one is due now
+    if ( mLowPriorityServiceRatio && mHighPriorityStreak >= mLowPriorityServiceRatio
+        && popLowPriorityEvent( eventCode, eventParam ) )
+    {
+        mHighPriorityStreak = 0;
+        *pri = kLowPriority;
+        return true;
+    }
+
+    if ( popLiveEvent( mHighPriorityQueue, eventCode, eventParam ) )
+    {
+        if ( !hasLowPriorityEvents() )
+        {
+            mHighPriorityStreak = 0;
+        }
+        else if ( mHighPriorityStreak < 255 )
+        {
+            mHighPriorityStreak++;
+        }
+        *pri = kHighPriority;
+        return true;
+    }
+
+    mHighPriorityStreak = 0;
+
+    if ( popSourceOrLowPriorityEvent( eventCode, eventParam ) )
+    {
+        *pri = kLowPriority;
+        return true;
+    }
+
+    return false;
+}
+
+
+bool EventManager::popSourceOrLowPriorityEvent( int* eventCode, int* eventParam )
+{
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+    // Events from event sources come after high priority events and ahead of low priority events
+    if ( popSourceEvent( eventCode, eventParam ) )
+    {
+        return true;
+    }
+#endif
+
+    return popLowPriorityEvent( eventCode, eventParam );
+}
+
+
+int EventManager::dispatchEvent( int eventCode, int eventParam )
+{
+#if EVENTMANAGER_PAINT_SCHEDULER
+    if ( eventCode == kEventPaint )
+    {
+        // Further invalidations now schedule a new paint (after the frame interval)
+        mPaintPending = false;
+    }
+#endif
+
+    updateEventJoins( eventCode );
+
+    return mListeners.sendEvent( eventCode, eventParam );
+}
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+int EventManager::dispatchEvents( int eventCode, int* eventParams, uint8_t count )
+{
+#if EVENTMANAGER_PAINT_SCHEDULER
+    if ( eventCode == kEventPaint )
+    {
+        mPaintPending = false;
+    }
+#endif
+
+    updateEventJoins( eventCode );
+
+    return mListeners.sendEvents( eventCode, eventParams, count );
+}
+
+#endif
+
+
+void EventManager::updateEventJoins( int eventCode )
+{
+#if EVENTMANAGER_NUM_JOINS
+    for ( int k = 0; k < EVENTMANAGER_NUM_JOINS; k++ )
+    {
+        EventJoin& j = mJoins[ k ];
+        // Unsigned, so that codes below firstCode are out of range too
+        unsigned offset = static_cast<unsigned>( eventCode - j.firstCode );
+        if ( !j.mask || offset >= 16 || !( j.mask & ( 1U << offset ) ) )
+        {
+            continue;
+        }
+
+        j.arrived |= ( 1U << offset );
+        if ( j.arrived == j.mask && queueEvent( j.completionCode, j.completionParam, j.completionPri ) )
+        {
+            // Start waiting for the whole set again (if the completion event couldn't be
+            // queued, the next awaited event to arrive tries again)
+            j.arrived = 0;
+        }
+    }
+#else
+    (void) eventCode;
+#endif
+}
+
+
+#if EVENTMANAGER_NUM_JOINS
+
+bool EventManager::addEventJoin( int firstEventCode, uint16_t codeMask, int completionEventCode,
+                                 int completionEventParam, EventPriority pri )
+{
+    if ( !codeMask )
+    {
+        return false;
+    }
+
+    for ( int k = 0; k < EVENTMANAGER_NUM_JOINS; k++ )
+    {
+        EventJoin& j = mJoins[ k ];
+        if ( !j.mask )
+        {
+            j.firstCode = firstEventCode;
+            j.mask = codeMask;
+            j.arrived = 0;
+            j.completionCode = completionEventCode;
+            j.completionParam = completionEventParam;
+            j.completionPri = pri;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int EventManager::removeEventJoin( int completionEventCode )
+{
+    int numRemoved = 0;
+    for ( int k = 0; k < EVENTMANAGER_NUM_JOINS; k++ )
+    {
+        if ( mJoins[ k ].mask && mJoins[ k ].completionCode == completionEventCode )
+        {
+            mJoins[ k ].mask = 0;
+            numRemoved++;
+        }
+    }
+
+    return numRemoved;
+}
+
+#endif
+
+
 int EventManager::processEvent()
 {
     int eventCode;
     int param;
     int handledCount = 0;
+    EventPriority pri;
 
-    if ( mHighPriorityQueue.popEvent( &eventCode, &param ) )
-    {
-        handledCount = mListeners.sendEvent( eventCode, param );
+    servicePaintScheduler();
+    serviceEventTimers();
 
-        EVTMGR_DEBUG_PRINT( "processEvent() hi-pri event " )
-        EVTMGR_DEBUG_PRINT( eventCode )
-        EVTMGR_DEBUG_PRINT( ", " )
-        EVTMGR_DEBUG_PRINT( param )
-        EVTMGR_DEBUG_PRINT( " sent to " )
-        EVTMGR_DEBUG_PRINTLN( handledCount )
+    if ( !popNextEvent( &eventCode, &param, &pri ) )
+    {
+#if EVENTMANAGER_IDLE_SLEEP
+        idleSleep();
+#endif
+        return 0;
     }
 
-    // If no high-pri events handled (either because there are no high-pri events or
-    // because there are no listeners for them), then try low-pri events
-    if ( !handledCount && mLowPriorityQueue.popEvent( &eventCode, &param ) )
+    handledCount = dispatchEvent( eventCode, param );
+
+    EVTMGR_DEBUG_PRINT( "processEvent() " )
+    EVTMGR_DEBUG_PRINT( pri == kHighPriority ? "hi-pri event " : "lo-pri event " )
+    EVTMGR_DEBUG_PRINT( eventCode )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINT( param )
+    EVTMGR_DEBUG_PRINT( " sent to " )
+    EVTMGR_DEBUG_PRINTLN( handledCount )
+
+    // If the high-pri event wasn't handled (because there are no listeners for it),
+    // then try a low-pri event (event sources first, as in popNextEvent())
+    if ( !handledCount && pri == kHighPriority && popSourceOrLowPriorityEvent( &eventCode, &param ) )
     {
-        handledCount = mListeners.sendEvent( eventCode, param );
+        mHighPriorityStreak = 0;
+        handledCount = dispatchEvent( eventCode, param );
 
         EVTMGR_DEBUG_PRINT( "processEvent() lo-pri event " )
         EVTMGR_DEBUG_PRINT( eventCode )
@@ -375,30 +2375,94 @@ int EventManager::processAllEvents()
     int eventCode;
     int param;
     int handledCount = 0;
+    EventPriority pri;
 
-    while ( mHighPriorityQueue.popEvent( &eventCode, &param ) )
+#if EVENTMANAGER_IDLE_SLEEP
+    bool processed = false;
+#endif
+
+    servicePaintScheduler();
+    serviceEventTimers();
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+    // Runs of events with the same code are gathered here for batch listeners.  The event that
+    // ends a run has already been popped, so it is held over (as params[ 0 ]) to start the next one.
+    int params[ EVENTMANAGER_MAX_BATCH_SIZE ];
+    bool held = false;
+
+    while ( held || popNextEvent( &eventCode, &params[ 0 ], &pri ) )
     {
-        handledCount += mListeners.sendEvent( eventCode, param );
+        held = false;
+        param = params[ 0 ];
 
-        EVTMGR_DEBUG_PRINT( "processEvent() hi-pri event " )
-        EVTMGR_DEBUG_PRINT( eventCode )
-        EVTMGR_DEBUG_PRINT( ", " )
-        EVTMGR_DEBUG_PRINT( param )
-        EVTMGR_DEBUG_PRINT( " sent to " )
-        EVTMGR_DEBUG_PRINTLN( handledCount )
-    }
+        if ( mListeners.hasBatchListener( eventCode ) )
+        {
+            int nextCode;
+            EventPriority nextPri;
+            uint8_t count = 1;
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+            uint16_t stamp = mCurrentEventStamp;
+#endif
+            while ( count < EVENTMANAGER_MAX_BATCH_SIZE && popNextEvent( &nextCode, &params[ count ], &nextPri ) )
+            {
+                if ( nextCode != eventCode )
+                {
+                    held = true;
+                    break;
+                }
+                count++;
+            }
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+            // getEventAge() reports the age of the first event of the run
+            uint16_t heldStamp = mCurrentEventStamp;
+            mCurrentEventStamp = stamp;
+#endif
+            handledCount += dispatchEvents( eventCode, params, count );
+
+            if ( held )
+            {
+                eventCode = nextCode;
+                params[ 0 ] = params[ count ];
+                pri = nextPri;
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+                mCurrentEventStamp = heldStamp;
+#endif
+            }
 
-    while ( mLowPriorityQueue.popEvent( &eventCode, &param ) )
+            EVTMGR_DEBUG_PRINT( "processAllEvents() batch of " )
+            EVTMGR_DEBUG_PRINTLN( count )
+
+#if EVENTMANAGER_IDLE_SLEEP
+            processed = true;
+#endif
+            continue;
+        }
+#else
+    while ( popNextEvent( &eventCode, &param, &pri ) )
     {
-        handledCount += mListeners.sendEvent( eventCode, param );
+#endif
+        handledCount += dispatchEvent( eventCode, param );
 
-        EVTMGR_DEBUG_PRINT( "processEvent() lo-pri event " )
+        EVTMGR_DEBUG_PRINT( "processAllEvents() " )
+        EVTMGR_DEBUG_PRINT( pri == kHighPriority ? "hi-pri event " : "lo-pri event " )
         EVTMGR_DEBUG_PRINT( eventCode )
         EVTMGR_DEBUG_PRINT( ", " )
         EVTMGR_DEBUG_PRINT( param )
         EVTMGR_DEBUG_PRINT( " sent to " )
         EVTMGR_DEBUG_PRINTLN( handledCount )
+
+#if EVENTMANAGER_IDLE_SLEEP
+        processed = true;
+#endif
+    }
+
+#if EVENTMANAGER_IDLE_SLEEP
+    if ( !processed )
+    {
+        idleSleep();
     }
+#endif
 
     return handledCount;
 }
@@ -409,11 +2473,6 @@ int EventManager::processAllEvents()
 
 
 
-EventManager::ListenerList::ListenerList() :
-mNumListeners( 0 ), mDefaultCallback( 0 )
-{
-}
-
 int EventManager::ListenerList::numListeners()
 {
     return mNumListeners;
@@ -424,30 +2483,138 @@ int EventManager::numListeners()
     return mListeners.numListeners();
 };
 
-bool EventManager::ListenerList::addListener( int eventCode, EventListener listener )
+bool EventManager::ListenerList::addListener( int eventCode, EventListener listener, uint8_t group, int8_t priority )
+{
+    return addEntry( kMatchExact | kKindListener, eventCode, 0, makeCallback( listener ), group, priority );
+}
+
+
+bool EventManager::ListenerList::addConsumingListener( int eventCode, EventConsumer consumer, uint8_t group, int8_t priority )
+{
+    return addEntry( kMatchExact | kKindConsumer, eventCode, 0, makeCallback( consumer ), group, priority );
+}
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+bool EventManager::ListenerList::addBatchListener( int eventCode, EventBatchListener listener, uint8_t group, int8_t priority )
+{
+    return addEntry( kMatchExact | kKindBatch, eventCode, 0, makeCallback( listener ), group, priority );
+}
+
+
+bool EventManager::ListenerList::hasBatchListener( int eventCode )
+{
+    for ( int i = 0; i < mNumListeners; i++ )
+    {
+        if ( ( mListeners[ i ].flags & kKindMask ) == kKindBatch && mListeners[ i ].eventCode == eventCode
+            && isActive( mListeners[ i ] ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
+
+
+bool EventManager::ListenerList::addOneShotListener( int eventCode, EventListener listener, uint8_t group, int8_t priority )
+{
+    return addEntry( kMatchExact | kKindOneShot, eventCode, 0, makeCallback( listener ), group, priority );
+}
+
+
+#if EVENTMANAGER_RANGE_LISTENERS
+
+bool EventManager::ListenerList::addRangeListener( int loEventCode, int hiEventCode, EventListener listener, uint8_t group, int8_t priority )
+{
+    // Argument check
+    if ( loEventCode > hiEventCode )
+    {
+        return false;
+    }
+
+    return addEntry( kMatchRange, loEventCode, hiEventCode, makeCallback( listener ), group, priority );
+}
+
+
+bool EventManager::ListenerList::addMaskListener( int eventMask, int eventValue, EventListener listener, uint8_t group, int8_t priority )
+{
+    // Store the value pre-masked so that matching is a single AND and compare
+    return addEntry( kMatchMask, eventValue & eventMask, eventMask, makeCallback( listener ), group, priority );
+}
+
+#endif
+
+
+bool EventManager::ListenerList::addEntry( uint8_t flags, int eventCode, int eventCodeAux, Callback callback, uint8_t group, int8_t priority )
 {
     EVTMGR_DEBUG_PRINT( "addListener() enter " )
+    EVTMGR_DEBUG_PRINT( flags )
+    EVTMGR_DEBUG_PRINT( ", " )
     EVTMGR_DEBUG_PRINT( eventCode )
     EVTMGR_DEBUG_PRINT( ", " )
-    EVTMGR_DEBUG_PRINTLN_PTR( listener )
+    EVTMGR_DEBUG_PRINTLN( eventCodeAux )
 
     // Argument check
-    if ( !listener )
+    if ( !hasCallback( flags & kKindMask, callback ) || group >= kNumListenerGroups )
     {
         return false;
     }
 
-    // Check for full dispatch table
+    int k;
     if ( isFull() )
     {
-        EVTMGR_DEBUG_PRINTLN( "addListener() list full" )
-        return false;
+        // Entries retired during dispatch still take up room until the table is tidied, so
+        // reuse one that sendEvent() has already passed (e.g., for a one-shot listener that
+        // re-arms itself); sendEvent() restores the priority order afterwards
+        k = mDispatchDepth ? searchRetiredEntry() : -1;
+        if ( k < 0 )
+        {
+            EVTMGR_DEBUG_PRINTLN( "addListener() list full" )
+            return false;
+        }
+    }
+    else
+    {
+        // The table is kept sorted by descending priority (ties in order of installation) so that
+        // sendEvent() visits higher priority listeners first without any sorting at dispatch time.
+        // While sendEvent() is iterating, append instead and let it restore the order afterwards.
+        k = mNumListeners++;
+#if EVENTMANAGER_LISTENER_PRIORITIES
+        if ( mDispatchDepth )
+        {
+            mTidyPending = true;
+        }
+        else
+        {
+            while ( k > 0 && mListeners[ k - 1 ].priority < priority )
+            {
+                mListeners[ k ] = mListeners[ k - 1 ];
+                k--;
+            }
+        }
+#endif
     }
 
-    mListeners[ mNumListeners ].callback = listener;
-    mListeners[ mNumListeners ].eventCode = eventCode;
-    mListeners[ mNumListeners ].enabled 	= true;
-    mNumListeners++;
+#if !EVENTMANAGER_LISTENER_PRIORITIES
+    // Without listener priorities, entries are simply kept in order of installation
+    (void) priority;
+#endif
+
+    mListeners[ k ].callback = callback;
+    mListeners[ k ].eventCode = eventCode;
+#if EVENTMANAGER_RANGE_LISTENERS
+    mListeners[ k ].eventCodeAux = eventCodeAux;
+#else
+    (void) eventCodeAux;
+#endif
+    mListeners[ k ].flags = flags | ( group << kGroupShift );
+#if EVENTMANAGER_LISTENER_PRIORITIES
+    mListeners[ k ].priority = priority;
+#endif
 
     EVTMGR_DEBUG_PRINTLN( "addListener() listener added" )
 
@@ -456,11 +2623,59 @@ bool EventManager::ListenerList::addListener( int eventCode, EventListener liste
 
 
 bool EventManager::ListenerList::removeListener( int eventCode, EventListener listener )
+{
+    return removeEntry( kMatchExact, eventCode, 0, kKindListener, makeCallback( listener ) );
+}
+
+
+bool EventManager::ListenerList::removeListener( int eventCode, EventConsumer consumer )
+{
+    return removeEntry( kMatchExact, eventCode, 0, kKindConsumer, makeCallback( consumer ) );
+}
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+bool EventManager::ListenerList::removeListener( int eventCode, EventBatchListener listener )
+{
+    return removeEntry( kMatchExact, eventCode, 0, kKindBatch, makeCallback( listener ) );
+}
+
+#endif
+
+
+#if EVENTMANAGER_RANGE_LISTENERS
+
+bool EventManager::ListenerList::removeRangeListener( int loEventCode, int hiEventCode, EventListener listener )
+{
+    return removeEntry( kMatchRange, loEventCode, hiEventCode, kKindListener, makeCallback( listener ) );
+}
+
+
+bool EventManager::ListenerList::removeMaskListener( int eventMask, int eventValue, EventListener listener )
+{
+    return removeEntry( kMatchMask, eventValue & eventMask, eventMask, kKindListener, makeCallback( listener ) );
+}
+
+#endif
+
+
+bool EventManager::ListenerList::removeEntry( uint8_t matchType, int eventCode, int eventCodeAux, uint8_t kind, Callback callback )
 {
     EVTMGR_DEBUG_PRINT( "removeListener() enter " )
+    EVTMGR_DEBUG_PRINT( matchType )
+    EVTMGR_DEBUG_PRINT( ", " )
     EVTMGR_DEBUG_PRINT( eventCode )
     EVTMGR_DEBUG_PRINT( ", " )
-    EVTMGR_DEBUG_PRINTLN_PTR( listener )
+    EVTMGR_DEBUG_PRINT( eventCodeAux )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINTLN( kind )
+
+    // Argument check (retired entries hold a null callback, so it never names a listener)
+    if ( !hasCallback( kind, callback ) )
+    {
+        return false;
+    }
 
     if ( mNumListeners == 0 )
     {
@@ -468,20 +2683,14 @@ bool EventManager::ListenerList::removeListener( int eventCode, EventListener li
         return false;
     }
 
-    int k = searchListeners( eventCode, listener );
+    int k = searchListeners( matchType, eventCode, eventCodeAux, kind, callback );
     if ( k < 0 )
     {
         EVTMGR_DEBUG_PRINTLN( "removeListener() not found" )
         return false;
     }
 
-    for ( int i = k; i < mNumListeners - 1; i++ )
-    {
-        mListeners[ i ].callback  = mListeners[ i + 1 ].callback;
-        mListeners[ i ].eventCode = mListeners[ i + 1 ].eventCode;
-        mListeners[ i ].enabled   = mListeners[ i + 1 ].enabled;
-    }
-    mNumListeners--;
+    removeEntryAt( k );
 
     EVTMGR_DEBUG_PRINTLN( "removeListener() removed" )
 
@@ -490,9 +2699,37 @@ bool EventManager::ListenerList::removeListener( int eventCode, EventListener li
 
 
 int EventManager::ListenerList::removeListener( EventListener listener )
+{
+    return removeEntries( kKindListener, makeCallback( listener ) );
+}
+
+
+int EventManager::ListenerList::removeListener( EventConsumer consumer )
+{
+    return removeEntries( kKindConsumer, makeCallback( consumer ) );
+}
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+int EventManager::ListenerList::removeListener( EventBatchListener listener )
+{
+    return removeEntries( kKindBatch, makeCallback( listener ) );
+}
+
+#endif
+
+
+int EventManager::ListenerList::removeEntries( uint8_t kind, Callback callback )
 {
     EVTMGR_DEBUG_PRINT( "removeListener() enter " )
-    EVTMGR_DEBUG_PRINTLN_PTR( listener )
+    EVTMGR_DEBUG_PRINTLN( kind )
+
+    // Argument check
+    if ( !hasCallback( kind, callback ) )
+    {
+        return 0;
+    }
 
     if ( mNumListeners == 0 )
     {
@@ -502,15 +2739,9 @@ int EventManager::ListenerList::removeListener( EventListener listener )
 
     int removed = 0;
     int k;
-    while ((k = searchListeners( listener )) >= 0 )
+    while ((k = searchListeners( kind, callback )) >= 0 )
     {
-        for ( int i = k; i < mNumListeners - 1; i++ )
-        {
-            mListeners[ i ].callback  = mListeners[ i + 1 ].callback;
-            mListeners[ i ].eventCode = mListeners[ i + 1 ].eventCode;
-            mListeners[ i ].enabled   = mListeners[ i + 1 ].enabled;
-        }
-        mNumListeners--;
+        removeEntryAt( k );
         removed++;
    }
 
@@ -522,28 +2753,63 @@ int EventManager::ListenerList::removeListener( EventListener listener )
 
 
 bool EventManager::ListenerList::enableListener( int eventCode, EventListener listener, bool enable )
+{
+    return enableEntry( eventCode, kKindListener, makeCallback( listener ), enable );
+}
+
+
+bool EventManager::ListenerList::enableListener( int eventCode, EventConsumer consumer, bool enable )
+{
+    return enableEntry( eventCode, kKindConsumer, makeCallback( consumer ), enable );
+}
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+bool EventManager::ListenerList::enableListener( int eventCode, EventBatchListener listener, bool enable )
+{
+    return enableEntry( eventCode, kKindBatch, makeCallback( listener ), enable );
+}
+
+#endif
+
+
+bool EventManager::ListenerList::enableEntry( int eventCode, uint8_t kind, Callback callback, bool enable )
 {
     EVTMGR_DEBUG_PRINT( "enableListener() enter " )
     EVTMGR_DEBUG_PRINT( eventCode )
     EVTMGR_DEBUG_PRINT( ", " )
-    EVTMGR_DEBUG_PRINT_PTR( listener )
+    EVTMGR_DEBUG_PRINT( kind )
     EVTMGR_DEBUG_PRINT( ", " )
     EVTMGR_DEBUG_PRINTLN( enable )
 
+    // Argument check
+    if ( !hasCallback( kind, callback ) )
+    {
+        return false;
+    }
+
     if ( mNumListeners == 0 )
     {
         EVTMGR_DEBUG_PRINTLN( "enableListener() no listeners" )
         return false;
     }
 
-    int k = searchListeners( eventCode, listener );
+    int k = searchListeners( kMatchExact, eventCode, 0, kind, callback );
     if ( k < 0 )
     {
         EVTMGR_DEBUG_PRINTLN( "enableListener() not found fail" )
         return false;
     }
 
-    mListeners[ k ].enabled = enable;
+    if ( enable )
+    {
+        mListeners[ k ].flags &= ~kFlagDisabled;
+    }
+    else
+    {
+        mListeners[ k ].flags |= kFlagDisabled;
+    }
 
     EVTMGR_DEBUG_PRINTLN( "enableListener() success" )
     return true;
@@ -557,56 +2823,240 @@ bool EventManager::ListenerList::isListenerEnabled( int eventCode, EventListener
         return false;
     }
 
-    int k = searchListeners( eventCode, listener );
+    int k = searchListeners( kMatchExact, eventCode, 0, kKindListener, makeCallback( listener ) );
     if ( k < 0 )
     {
         return false;
     }
 
-    return mListeners[ k ].enabled;
+    return !( mListeners[ k ].flags & kFlagDisabled );
 }
 
 
 int EventManager::ListenerList::sendEvent( int eventCode, int param )
+{
+    return sendEvents( eventCode, &param, 1 );
+}
+
+
+int EventManager::ListenerList::sendEvents( int eventCode, int* params, uint8_t count )
 {
     EVTMGR_DEBUG_PRINT( "sendEvent() enter " )
     EVTMGR_DEBUG_PRINT( eventCode )
     EVTMGR_DEBUG_PRINT( ", " )
-    EVTMGR_DEBUG_PRINTLN( param )
+    EVTMGR_DEBUG_PRINT( params[ 0 ] )
+    EVTMGR_DEBUG_PRINT( " x " )
+    EVTMGR_DEBUG_PRINTLN( count )
+
+    int handlerCount = 0;
+    mDispatchDepth++;
+
+    // Entries added by listeners during this dispatch are appended past n; they only
+    // apply from the next event (so a one-shot listener can re-arm itself)
+    int n = mNumListeners;
+    int outerReuseLimit = mReuseLimit;
+    for ( int i = 0; i < n; i++ )
+    {
+        if ( matches( mListeners[ i ], eventCode ) && isActive( mListeners[ i ] ) )
+        {
+            // Retired entries up to this one may be reused by listeners adding entries
+            // (unless an outer dispatch has yet to pass them)
+            mReuseLimit = ( i < outerReuseLimit ) ? i : outerReuseLimit;
+            handlerCount++;
+            Callback callback = mListeners[ i ].callback;
+            uint8_t kind = mListeners[ i ].flags & kKindMask;
+
+            // A one-shot listener only sees the first event of a run
+            uint8_t calls = count;
+            if ( kind == kKindOneShot )
+            {
+                // Retire the entry before calling it, so the listener may safely re-arm itself
+                retireEntryAt( i );
+                calls = 1;
+            }
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+            if ( kind == kKindBatch )
+            {
+                (*callback.batch)( eventCode, params, count );
+            }
+            else
+#endif
+            if ( kind == kKindConsumer )
+            {
+                // Keep only the events that aren't consumed
+                // (if the consumer removes or disables itself, it keeps the rest of the run)
+                uint8_t kept = 0;
+                for ( uint8_t k = 0; k < count; k++ )
+                {
+                    if ( ( k && !isStillActive( i, kind, callback ) ) || !(*callback.consumer)( eventCode, params[ k ] ) )
+                    {
+                        params[ kept++ ] = params[ k ];
+                    }
+                }
+
+                count = kept;
+                if ( !count )
+                {
+                    // Event consumed; lower priority listeners don't see it
+                    EVTMGR_DEBUG_PRINTLN( "sendEvent() event consumed" )
+                    break;
+                }
+            }
+            else
+            {
+                for ( uint8_t k = 0; k < calls; k++ )
+                {
+                    // Stop if the listener has removed or disabled itself during the run
+                    if ( k && !isStillActive( i, kind, callback ) )
+                    {
+                        break;
+                    }
+                    (*callback.listener)( eventCode, params[ k ] );
+                }
+            }
+        }
+    }
+
+    mReuseLimit = outerReuseLimit;
+
+#if EVENTMANAGER_SECTION_LISTENERS
+    // Listeners registered at link time come after the dispatch table
+    if ( count )
+    {
+        handlerCount += sendToTable( __start_evtmgr_listeners, __stop_evtmgr_listeners - __start_evtmgr_listeners,
+                                     true, eventCode, params, count );
+    }
+#endif
+
+#if EVENTMANAGER_LISTENER_TABLES
+    // The active listener table comes last; the dispatch table acts as its base table.
+    // It may be swapped by an interrupt handler, so take a consistent copy of it first.
+    const ListenerTableEntry* table;
+    uint8_t tableSize;
+    bool tableInFlash;
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        table = mTable;
+        tableSize = mTableSize;
+        tableInFlash = mTableInFlash;
+    }
+    // ATOMIC BLOCK END
+
+    if ( count && table )
+    {
+        handlerCount += sendToTable( table, tableSize, tableInFlash, eventCode, params, count );
+    }
+#endif
+    mDispatchDepth--;
+
+    if ( mTidyPending && !mDispatchDepth )
+    {
+        tidy();
+    }
+
+    EVTMGR_DEBUG_PRINT( "sendEvent() sent to " )
+    EVTMGR_DEBUG_PRINTLN( handlerCount )
+
+    if ( !handlerCount )
+    {
+        if ( ( mDefaultCallback != 0 ) && mDefaultCallbackEnabled )
+        {
+            handlerCount++;
+            for ( uint8_t k = 0; k < count; k++ )
+            {
+                (*mDefaultCallback)( eventCode, params[ k ] );
+            }
+
+            EVTMGR_DEBUG_PRINTLN( "sendEvent() event sent to default" )
+        }
+
+#if EVENTMANAGER_DEBUG
+        else
+        {
+            EVTMGR_DEBUG_PRINTLN( "sendEvent() no default" )
+        }
+#endif
+
+    }
+
+    return handlerCount;
+}
+
+
+#if EVENTMANAGER_LISTENER_TABLES || EVENTMANAGER_SECTION_LISTENERS
+
+int EventManager::ListenerList::sendToTable( const ListenerTableEntry* table, int numEntries, bool inFlash,
+                                             int eventCode, const int* params, uint8_t count )
+{
+    // The table pointer and size are copied by the caller, so a listener may swap tables
+    int handlerCount = 0;
+    for ( int i = 0; i < numEntries; i++ )
+    {
+        ListenerTableEntry entry;
+        if ( inFlash )
+        {
+            memcpy_P( &entry, &table[ i ], sizeof( entry ) );
+        }
+        else
+        {
+            entry = table[ i ];
+        }
+
+        if ( entry.eventCode == eventCode && entry.listener )
+        {
+            handlerCount++;
+            for ( uint8_t k = 0; k < count; k++ )
+            {
+                (*entry.listener)( eventCode, params[ k ] );
+            }
+        }
+    }
+
+    return handlerCount;
+}
+
+#endif
+
+
+void EventManager::ListenerList::enableListenerGroup( uint8_t group, bool enable )
+{
+    EVTMGR_DEBUG_PRINT( "enableListenerGroup() " )
+    EVTMGR_DEBUG_PRINT( group )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINTLN( enable )
 
-    int handlerCount = 0;
-    for ( int i = 0; i < mNumListeners; i++ )
+    if ( group >= kNumListenerGroups )
     {
-        if ( ( mListeners[ i ].callback != 0 ) && ( mListeners[ i ].eventCode == eventCode ) && mListeners[ i ].enabled )
-        {
-            handlerCount++;
-            (*mListeners[ i ].callback)( eventCode, param );
-        }
+        return;
     }
 
-    EVTMGR_DEBUG_PRINT( "sendEvent() sent to " )
-    EVTMGR_DEBUG_PRINTLN( handlerCount )
-
-    if ( !handlerCount )
+    if ( enable )
     {
-        if ( ( mDefaultCallback != 0 ) && mDefaultCallbackEnabled )
-        {
-            handlerCount++;
-            (*mDefaultCallback)( eventCode, param );
+        mDisabledGroups &= ~( 1 << group );
+    }
+    else
+    {
+        mDisabledGroups |= ( 1 << group );
+    }
+}
 
-            EVTMGR_DEBUG_PRINTLN( "sendEvent() event sent to default" )
-        }
 
-#if EVENTMANAGER_DEBUG
-        else
-        {
-            EVTMGR_DEBUG_PRINTLN( "sendEvent() no default" )
-        }
-#endif
+void EventManager::ListenerList::setEnabledListenerGroups( uint8_t groupMask )
+{
+    mDisabledGroups = ~groupMask;
+}
 
+
+bool EventManager::ListenerList::isListenerGroupEnabled( uint8_t group )
+{
+    if ( group >= kNumListenerGroups )
+    {
+        return false;
     }
 
-    return handlerCount;
+    return !( mDisabledGroups & ( 1 << group ) );
 }
 
 
@@ -639,15 +3089,94 @@ void EventManager::ListenerList::enableDefaultListener( bool enable )
 }
 
 
-int EventManager::ListenerList::searchListeners( int eventCode, EventListener listener )
+void EventManager::ListenerList::removeEntryAt( int k )
+{
+    if ( mDispatchDepth )
+    {
+        // sendEvent() is iterating over the table (a listener is removing itself or another
+        // listener), so don't shift entries under it.  Retire the entry instead; sendEvent()
+        // skips retired entries and tidies the table once dispatch is done.
+        retireEntryAt( k );
+        return;
+    }
+
+    for ( int i = k; i < mNumListeners - 1; i++ )
+    {
+        mListeners[ i ] = mListeners[ i + 1 ];
+    }
+    mNumListeners--;
+}
+
+
+void EventManager::ListenerList::retireEntryAt( int k )
 {
+    mListeners[ k ].flags = ( mListeners[ k ].flags & ~kKindMask ) | kKindListener;
+    mListeners[ k ].callback.listener = 0;
+    mTidyPending = true;
+}
+
 
+void EventManager::ListenerList::tidy()
+{
+    // Squeeze out retired entries
+    int n = 0;
     for ( int i = 0; i < mNumListeners; i++ )
     {
+        if ( hasCallback( mListeners[ i ].flags & kKindMask, mListeners[ i ].callback ) )
+        {
+            if ( n != i )
+            {
+                mListeners[ n ] = mListeners[ i ];
+            }
+            n++;
+        }
+    }
+    mNumListeners = n;
+
+#if EVENTMANAGER_LISTENER_PRIORITIES
+    // Entries appended during dispatch may be out of priority order; a stable insertion
+    // sort restores it (and costs a single pass if nothing is out of order)
+    for ( int i = 1; i < mNumListeners; i++ )
+    {
+        ListenerItem item = mListeners[ i ];
+        int k = i;
+        while ( k > 0 && mListeners[ k - 1 ].priority < item.priority )
+        {
+            mListeners[ k ] = mListeners[ k - 1 ];
+            k--;
+        }
+        mListeners[ k ] = item;
+    }
+#endif
 
+    mTidyPending = false;
+}
+
+
+int EventManager::ListenerList::searchListeners( uint8_t matchType, int eventCode, int eventCodeAux, uint8_t kind, const Callback& callback )
+{
+#if !EVENTMANAGER_RANGE_LISTENERS
+    // Only range and mask entries have an auxiliary event code
+    (void) eventCodeAux;
+#endif
+
+    for ( int i = 0; i < mNumListeners; i++ )
+    {
+        // Skip entries retired during dispatch
+        if ( !hasCallback( mListeners[i].flags & kKindMask, mListeners[i].callback ) )
+        {
+            continue;
+        }
 
-        if ( ( mListeners[i].eventCode == eventCode ) && ( mListeners[i].callback == listener ) )
+        if ( ( mListeners[i].eventCode == eventCode ) && isCallback( mListeners[i], kind, callback )
+            && ( ( mListeners[i].flags & kMatchTypeMask ) == matchType ) )
         {
+#if EVENTMANAGER_RANGE_LISTENERS
+            if ( mListeners[i].eventCodeAux != eventCodeAux )
+            {
+                continue;
+            }
+#endif
             return i;
         }
     }
@@ -656,11 +3185,26 @@ int EventManager::ListenerList::searchListeners( int eventCode, EventListener li
 }
 
 
-int EventManager::ListenerList::searchListeners( EventListener listener )
+int EventManager::ListenerList::searchListeners( uint8_t kind, const Callback& callback )
 {
     for ( int i = 0; i < mNumListeners; i++ )
     {
-        if ( mListeners[i].callback == listener )
+        // Skip entries retired during dispatch
+        if ( hasCallback( mListeners[i].flags & kKindMask, mListeners[i].callback ) && isCallback( mListeners[i], kind, callback ) )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+int EventManager::ListenerList::searchRetiredEntry()
+{
+    for ( int i = 0; i <= mReuseLimit && i < mNumListeners; i++ )
+    {
+        if ( !hasCallback( mListeners[i].flags & kKindMask, mListeners[i].callback ) )
         {
             return i;
         }
@@ -690,21 +3234,7 @@ int EventManager::ListenerList::searchEventCode( int eventCode )
 
 
 
-EventManager::EventQueue::EventQueue() :
-mEventQueueHead( 0 ),
-mEventQueueTail( 0 ),
-mNumEvents( 0 )
-{
-    for ( int i = 0; i < kEventQueueSize; i++ )
-    {
-        mEventQueue[i].code = EventManager::kEventNone;
-        mEventQueue[i].param = 0;
-    }
-}
-
-
-
-bool EventManager::EventQueue::queueEvent( int eventCode, int eventParam )
+bool EventManager::EventQueue::queueEvent( int eventCode, int eventParam, bool* merged )
 {
     /*
     * The call to noInterrupts() MUST come BEFORE the full queue check.
@@ -726,34 +3256,116 @@ bool EventManager::EventQueue::queueEvent( int eventCode, int eventParam )
     *
     * Contrast this with the logic in popEvent().
     *
+    * In the multi-producer (EVENTMANAGER_MPSC_QUEUE) variant, only the full check and the
+    * reservation of the tail slot happen with interrupts disabled.  The event is written into
+    * the reserved slot with interrupts enabled and then published by setting the slot's ready
+    * byte (a single, hence atomic, write).  The consumer never reads a slot that isn't ready, and
+    * no other producer can reserve the slot until the consumer has released it.
+    *
     */
 
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    // Read the time before disabling interrupts (the tick source may itself need interrupts)
+    uint16_t stamp = currentTick();
+#else
+    uint16_t stamp = 0;
+#endif
+
+#if EVENTMANAGER_DEDUPLICATION
+    bool dedup = ( eventCode >= 0 && eventCode < EVENTMANAGER_NUM_EVENT_CODES ) && isBitSet( mDeduplicatedCodes, eventCode );
+#else
+    // Without deduplication, events are never merged
+    (void) merged;
+#endif
+
     bool retVal = false;
+    int slot = -1;
+#if EVENTMANAGER_QUEUE_WATERMARKS
+    QueueWatermarkCallback throttle = 0;
+#endif
     // ATOMIC BLOCK BEGIN
     ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
     {
+#if EVENTMANAGER_DEDUPLICATION
+        int pending = dedup ? mPendingSlot[ eventCode ] - 1 : -1;
+        if ( pending >= 0
+#if EVENTMANAGER_MPSC_QUEUE
+            // A slot that isn't ready yet may hold a partially written event; don't compare with it
+            && mReady[ pending ]
+#endif
+            && mEventQueue[ pending ].param == eventParam )
+        {
+            // An identical event is already waiting; it will do the job
+            retVal = true;
+            if ( merged )
+            {
+                *merged = true;
+            }
+        }
+        else
+#endif
         if ( !isFull() )
         {
+            // Reserve the slot at the tail of the queue
+            slot = mEventQueueTail;
+
+#if EVENTMANAGER_DEDUPLICATION
+            if ( dedup )
+            {
+                mPendingSlot[ eventCode ] = slot + 1;
+            }
+#endif
+
+#if !EVENTMANAGER_MPSC_QUEUE
             // Store the event at the tail of the queue
-            mEventQueue[ mEventQueueTail ].code = eventCode;
-            mEventQueue[ mEventQueueTail ].param = eventParam;
+            storeEvent( slot, eventCode, eventParam, stamp );
+#endif
 
             // Update queue tail value
-            mEventQueueTail = ( mEventQueueTail + 1 ) % kEventQueueSize;;
+            mEventQueueTail = nextIndex( mEventQueueTail );
 
             // Update number of events in queue
             mNumEvents++;
 
+#if EVENTMANAGER_QUEUE_WATERMARKS
+            if ( mHighWatermark && !mThrottled && mNumEvents >= mHighWatermark )
+            {
+                mThrottled = true;
+                throttle = mWatermarkCallback;
+            }
+#endif
+
             retVal = true;
         }
     }
     // ATOMIC BLOCK END
 
+#if EVENTMANAGER_MPSC_QUEUE
+    if ( slot >= 0 )
+    {
+        // Write the event into the reserved slot with interrupts enabled, then publish it
+        storeEvent( slot, eventCode, eventParam, stamp );
+        __asm__ __volatile__ ( "" ::: "memory" );
+        mReady[ slot ] = 1;
+    }
+#else
+    (void) slot;
+#endif
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+    // The callback runs outside the atomic block, but still in the caller's context (possibly
+    // an interrupt handler with interrupts disabled)
+    if ( throttle )
+    {
+        throttle( true );
+    }
+#endif
+
     return retVal;
 }
 
 
-bool EventManager::EventQueue::popEvent( int* eventCode, int* eventParam )
+bool EventManager::EventQueue::popEvent( int* eventCode, int* eventParam, uint16_t* timestamp )
 {
     /*
     * The call to noInterrupts() MUST come AFTER the empty queue check.
@@ -779,24 +3391,281 @@ bool EventManager::EventQueue::popEvent( int* eventCode, int* eventParam )
         return false;
     }
 
+#if EVENTMANAGER_QUEUE_WATERMARKS
+    QueueWatermarkCallback release = 0;
+#endif
+
+#if EVENTMANAGER_MPSC_QUEUE
+    // Only the consumer moves the head, and producers don't touch a reserved slot once it is
+    // ready, so the event can be read with interrupts enabled.  If the producer that reserved
+    // the head slot hasn't published it yet, treat the queue as empty for now.
+    if ( !mReady[ mEventQueueHead ] )
+    {
+        return false;
+    }
+    __asm__ __volatile__ ( "" ::: "memory" );
+    loadEvent( mEventQueueHead, eventCode, eventParam, timestamp );
+    mReady[ mEventQueueHead ] = 0;
+    int nextHead = nextIndex( mEventQueueHead );
+#endif
+
     // ATOMIC BLOCK BEGIN
     ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
     {
+#if EVENTMANAGER_DEDUPLICATION
+        // The slot being popped
+        int head = mEventQueueHead;
+#endif
+
+#if EVENTMANAGER_MPSC_QUEUE
+        // Release the slot to the producers
+        mEventQueueHead = nextHead;
+#else
         // Pop the event from the head of the queue
         // Store event code and event parameter into the user-supplied variables
-        *eventCode  = mEventQueue[ mEventQueueHead ].code;
-        *eventParam = mEventQueue[ mEventQueueHead ].param;
-
-        // Clear the event (paranoia)
-        mEventQueue[ mEventQueueHead ].code = EventManager::kEventNone;
+        loadEvent( mEventQueueHead, eventCode, eventParam, timestamp );
 
         // Update the queue head value
-        mEventQueueHead = ( mEventQueueHead + 1 ) % kEventQueueSize;
+        mEventQueueHead = nextIndex( mEventQueueHead );
+#endif
 
         // Update number of events in queue
         mNumEvents--;
+
+#if EVENTMANAGER_DEDUPLICATION
+        // Once the most recently queued event with this code leaves, no event with it is pending
+        if ( *eventCode >= 0 && *eventCode < EVENTMANAGER_NUM_EVENT_CODES && mPendingSlot[ *eventCode ] == head + 1 )
+        {
+            mPendingSlot[ *eventCode ] = 0;
+        }
+#endif
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+        if ( mThrottled && mNumEvents <= mLowWatermark )
+        {
+            mThrottled = false;
+            release = mWatermarkCallback;
+        }
+#endif
+    }
+    // ATOMIC BLOCK END
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+    if ( release )
+    {
+        release( false );
+    }
+#endif
+
+    return true;
+}
+
+
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+
+bool EventManager::EventQueue::setWatermarks( uint8_t highWatermark, uint8_t lowWatermark, QueueWatermarkCallback callback )
+{
+    if ( highWatermark > kEventQueueSize || ( highWatermark && lowWatermark >= highWatermark ) )
+    {
+        return false;
+    }
+
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        mHighWatermark = highWatermark;
+        mLowWatermark = lowWatermark;
+        mWatermarkCallback = callback;
+        mThrottled = false;
+    }
+    // ATOMIC BLOCK END
+
+    return true;
+}
+
+#endif
+
+
+
+#if EVENTMANAGER_BACKLOG_SIZE
+
+/******************************************************************************/
+
+
+
+
+void EventManager::EventBacklog::spill( EventQueue& queue )
+{
+    // The backlog is only used by the main loop, so only popping from queue needs protection
+    uint16_t stamp = 0;
+    while ( mNumEvents < kBacklogSize && queue.popEvent( &mEvents[ mTail ].code, &mEvents[ mTail ].param, &stamp ) )
+    {
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+        mEvents[ mTail ].stamp = stamp;
+#endif
+#if EVENTMANAGER_DEDUPLICATION
+        // Deduplication in the queue can't see events already moved to the backlog,
+        // so duplicates of those are dropped here instead
+        int code = mEvents[ mTail ].code;
+        if ( isDuplicate( code, mEvents[ mTail ].param ) )
+        {
+            continue;
+        }
+
+        if ( code >= 0 && code < EVENTMANAGER_NUM_EVENT_CODES && isBitSet( mDeduplicatedCodes, code ) )
+        {
+            mPendingSlot[ code ] = mTail + 1;
+        }
+#endif
+        mTail = ( mTail + 1 < kBacklogSize ) ? mTail + 1 : 0;
+        mNumEvents++;
+    }
+}
+
+
+
+#if EVENTMANAGER_DEDUPLICATION
+
+bool EventManager::EventBacklog::isDuplicate( int eventCode, int eventParam )
+{
+    if ( eventCode < 0 || eventCode >= EVENTMANAGER_NUM_EVENT_CODES || !isBitSet( mDeduplicatedCodes, eventCode ) )
+    {
+        return false;
+    }
+
+    // Only the most recent event with this code needs comparing, as in EventQueue::queueEvent()
+    int pending = mPendingSlot[ eventCode ] - 1;
+    return pending >= 0 && mEvents[ pending ].param == eventParam;
+}
+
+#endif
+
+
+
+bool EventManager::EventBacklog::popEvent( int* eventCode, int* eventParam, uint16_t* timestamp )
+{
+    if ( !mNumEvents )
+    {
+        return false;
+    }
+
+    *eventCode = mEvents[ mHead ].code;
+    *eventParam = mEvents[ mHead ].param;
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    if ( timestamp )
+    {
+        *timestamp = mEvents[ mHead ].stamp;
+    }
+#else
+    (void) timestamp;
+#endif
+
+#if EVENTMANAGER_DEDUPLICATION
+    // Once the most recently spilled event with this code leaves, no event with it is pending
+    if ( *eventCode >= 0 && *eventCode < EVENTMANAGER_NUM_EVENT_CODES && mPendingSlot[ *eventCode ] == mHead + 1 )
+    {
+        mPendingSlot[ *eventCode ] = 0;
+    }
+#endif
+
+    mHead = ( mHead + 1 < kBacklogSize ) ? mHead + 1 : 0;
+    mNumEvents--;
+
+    return true;
+}
+
+#endif
+
+
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+
+/******************************************************************************/
+
+
+
+
+bool EventManager::DeadlineQueue::queueEvent( int eventCode, int eventParam, uint16_t deadline )
+{
+    // As with EventQueue::queueEvent(), the full check and the insertion must be atomic
+
+    bool retVal = false;
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( !isFull() )
+        {
+            DeadlineElement e;
+            e.code = eventCode;
+            e.param = eventParam;
+            e.deadline = deadline;
+
+            // Sift up from the new leaf
+            int i = mNumEvents++;
+            while ( i > 0 )
+            {
+                int parent = ( i - 1 ) / 2;
+                if ( !isEarlier( e, mHeap[ parent ] ) )
+                {
+                    break;
+                }
+                mHeap[ i ] = mHeap[ parent ];
+                i = parent;
+            }
+            mHeap[ i ] = e;
+
+            retVal = true;
+        }
+    }
+    // ATOMIC BLOCK END
+
+    return retVal;
+}
+
+
+bool EventManager::DeadlineQueue::popEvent( int* eventCode, int* eventParam )
+{
+    // As with EventQueue::popEvent(), check for empty BEFORE disabling interrupts
+
+    if ( isEmpty() )
+    {
+        return false;
+    }
+
+    // ATOMIC BLOCK BEGIN
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        // The root has the earliest deadline
+        *eventCode  = mHeap[ 0 ].code;
+        *eventParam = mHeap[ 0 ].param;
+
+        // Move the last leaf to the root and sift it down
+        DeadlineElement e = mHeap[ --mNumEvents ];
+        int i = 0;
+        for ( ;; )
+        {
+            int child = 2 * i + 1;
+            if ( child >= mNumEvents )
+            {
+                break;
+            }
+            if ( child + 1 < mNumEvents && isEarlier( mHeap[ child + 1 ], mHeap[ child ] ) )
+            {
+                child++;
+            }
+            if ( !isEarlier( mHeap[ child ], e ) )
+            {
+                break;
+            }
+            mHeap[ i ] = mHeap[ child ];
+            i = child;
+        }
+        mHeap[ i ] = e;
     }
     // ATOMIC BLOCK END
 
     return true;
 }
+
+#endif
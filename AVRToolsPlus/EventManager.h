@@ -51,6 +51,30 @@
  * file EventManager.h, each time it is included.  Define it using a compiler option
  * (e.g., \c -DEVENTMANAGER_EVENT_QUEUE_SIZE=32) to ensure it is consistently defined throughout your project.
  *
+ * Optional features that cost additional RAM are disabled by default and are enabled the same way:
+ * - \c EVENTMANAGER_RANGE_LISTENERS=1 enables listeners for ranges and masks of event codes (see addRangeListener()).
+ * - \c EVENTMANAGER_LISTENER_PRIORITIES=1 enables listener dispatch priorities (see addListener()).
+ * - \c EVENTMANAGER_DEADLINE_QUEUE=1 enables an earliest-deadline-first event queue (see queueEventWithDeadline()).
+ * - \c EVENTMANAGER_EVENT_TIMESTAMPS=1 enables event timestamps and time-to-live (see setEventTimeToLive()).
+ * - \c EVENTMANAGER_LISTENER_TABLES=1 enables swappable, optionally flash-resident, listener tables (see setActiveListenerTable()).
+ * - \c EVENTMANAGER_SECTION_LISTENERS=1 enables listeners registered at link time (see EVENTMANAGER_REGISTER_LISTENER()).
+ * - \c EVENTMANAGER_NUM_JOINS=n enables n joins that post an event once a set of events has occurred (see addEventJoin()).
+ * - \c EVENTMANAGER_EVENT_COUNTERS=1 enables counter-only event codes (see enableEventCounter()).
+ * - \c EVENTMANAGER_RATE_LIMITS=1 enables per-event-code rate limits (see setEventRateLimit()).
+ * - \c EVENTMANAGER_MAX_BATCH_SIZE=n enables batch listeners receiving up to n events per call (see addBatchListener()).
+ * - \c EVENTMANAGER_DEFAULT_PRIORITIES=1 enables per event code default priorities (see setDefaultEventPriority()).
+ * - \c EVENTMANAGER_DEDUPLICATION=1 enables deduplication of pending events (see enableEventDeduplication()).
+ * - \c EVENTMANAGER_PAINT_SCHEDULER=1 enables frame-rate limited kEventPaint events (see invalidateRegion()).
+ * - \c EVENTMANAGER_MPSC_QUEUE=1 selects event queues that write and read events with interrupts enabled.
+ * - \c EVENTMANAGER_QUEUE_WATERMARKS=1 enables flow control callbacks on event queue watermarks (see setEventQueueWatermarks()).
+ * - \c EVENTMANAGER_NUM_TIMERS=n enables n event timers (see setEventTimer()).
+ * - \c EVENTMANAGER_IDLE_SLEEP=1 lets the event loop put the processor to sleep when it is idle (see enableIdleSleep()).
+ * - \c EVENTMANAGER_BACKLOG_SIZE=n backs the low priority event queue with an n event main-loop backlog.
+ * - \c EVENTMANAGER_MAX_EVENT_SOURCES=n enables up to n lock-free per-source event queues (see EventSource).
+ *
+ * Per-event-code tables used by some of these features cover event codes 0 through
+ * \c EVENTMANAGER_NUM_EVENT_CODES - 1 (default 40).
+ *
  */
 
 
@@ -61,10 +85,14 @@
 
 #include <stdint.h>
 
+#if EVENTMANAGER_IDLE_SLEEP
+#include <avr/sleep.h>
+#endif
+
 
 
 // Size of the listener list.  Adjust as appropriate for your application.
-// Requires a total of sizeof(*f())+sizeof(int)+sizeof(bool) bytes of RAM for each unit of size
+// Requires a total of sizeof(*f())+sizeof(int)+1 bytes of RAM for each unit of size
 #ifndef EVENTMANAGER_DISPATCH_TABLE_SIZE
 #define EVENTMANAGER_DISPATCH_TABLE_SIZE        8
 #endif
@@ -76,6 +104,24 @@
 
 
 
+// Enable range and mask listeners (see addRangeListener() and addMaskListener()).
+// Requires sizeof(int) additional bytes of RAM for each dispatch table entry
+#ifndef EVENTMANAGER_RANGE_LISTENERS
+#define EVENTMANAGER_RANGE_LISTENERS            0
+#endif
+
+
+
+
+// Enable listener dispatch priorities (the priority argument of addListener() and friends).
+// Requires 1 additional byte of RAM for each dispatch table entry
+#ifndef EVENTMANAGER_LISTENER_PRIORITIES
+#define EVENTMANAGER_LISTENER_PRIORITIES        0
+#endif
+
+
+
+
 // Size of the event two queues.  Adjust as appropriate for your application.
 // Requires a total of 4 * sizeof(int) bytes of RAM for each unit of size
 #ifndef EVENTMANAGER_EVENT_QUEUE_SIZE
@@ -89,6 +135,200 @@
 
 
 
+// Number of event codes (0 to EVENTMANAGER_NUM_EVENT_CODES - 1) covered by per-event-code tables
+// used by optional features such as event time-to-live.  Event codes outside this range can be
+// queued and dispatched as usual, but per-code features do not apply to them.
+#ifndef EVENTMANAGER_NUM_EVENT_CODES
+#define EVENTMANAGER_NUM_EVENT_CODES            40
+#endif
+
+
+
+
+// Enable event timestamps and per-event-code time-to-live.
+// Requires 2 additional bytes of RAM per event queue slot, plus 2 * EVENTMANAGER_NUM_EVENT_CODES bytes
+#ifndef EVENTMANAGER_EVENT_TIMESTAMPS
+#define EVENTMANAGER_EVENT_TIMESTAMPS           0
+#endif
+
+
+
+
+// Enable swappable listener tables (see setActiveListenerTable()).  Requires sizeof(void*) + 2 bytes of RAM
+#ifndef EVENTMANAGER_LISTENER_TABLES
+#define EVENTMANAGER_LISTENER_TABLES            0
+#endif
+
+
+
+
+// Enable listeners registered at link time with EVENTMANAGER_REGISTER_LISTENER().  Requires no RAM
+#ifndef EVENTMANAGER_SECTION_LISTENERS
+#define EVENTMANAGER_SECTION_LISTENERS          0
+#endif
+
+
+
+
+// Number of event joins (see addEventJoin()).  0 (the default) disables event joins.
+// Requires 3 * sizeof(int) + 5 bytes of RAM for each unit
+#ifndef EVENTMANAGER_NUM_JOINS
+#define EVENTMANAGER_NUM_JOINS                  0
+#endif
+
+#if EVENTMANAGER_NUM_JOINS > 255
+#error "EVENTMANAGER_NUM_JOINS exceeds size of a uint8_t"
+#endif
+
+
+
+
+// Enable counter-only event codes, which are counted by queueEvent() instead of being queued.
+// Requires 2 * EVENTMANAGER_NUM_EVENT_CODES + ( EVENTMANAGER_NUM_EVENT_CODES + 7 ) / 8 additional bytes of RAM
+#ifndef EVENTMANAGER_EVENT_COUNTERS
+#define EVENTMANAGER_EVENT_COUNTERS             0
+#endif
+
+
+
+
+// Enable per-event-code rate limits.
+// Requires 5 * EVENTMANAGER_NUM_EVENT_CODES additional bytes of RAM
+#ifndef EVENTMANAGER_RATE_LIMITS
+#define EVENTMANAGER_RATE_LIMITS                0
+#endif
+
+
+
+
+// Maximum number of consecutive events with the same code that processAllEvents() delivers to a
+// batch listener in one call (see addBatchListener()).  0 (the default) disables batch listeners.
+// processAllEvents() needs this many ints of stack
+#ifndef EVENTMANAGER_MAX_BATCH_SIZE
+#define EVENTMANAGER_MAX_BATCH_SIZE             0
+#endif
+
+#if EVENTMANAGER_MAX_BATCH_SIZE > 255
+#error "EVENTMANAGER_MAX_BATCH_SIZE exceeds size of a uint8_t"
+#endif
+
+
+
+
+// Enable the table of default event priorities used by queueEvent() when no priority is given.
+// Requires EVENTMANAGER_NUM_EVENT_CODES bytes of RAM
+#ifndef EVENTMANAGER_DEFAULT_PRIORITIES
+#define EVENTMANAGER_DEFAULT_PRIORITIES         0
+#endif
+
+
+
+
+// Enable deduplication of identical pending events.
+// Requires 2 * EVENTMANAGER_NUM_EVENT_CODES + ( EVENTMANAGER_NUM_EVENT_CODES + 7 ) / 8 additional bytes of RAM
+#ifndef EVENTMANAGER_DEDUPLICATION
+#define EVENTMANAGER_DEDUPLICATION              0
+#endif
+
+
+
+
+// Enable the paint scheduler, which rate-limits kEventPaint events to one per frame interval.
+// Requires 4 * sizeof(int) + 6 additional bytes of RAM
+#ifndef EVENTMANAGER_PAINT_SCHEDULER
+#define EVENTMANAGER_PAINT_SCHEDULER            0
+#endif
+
+
+
+
+// Use the multi-producer event queue variant, which keeps interrupts disabled only long enough
+// to reserve a queue slot.  Requires 1 additional byte of RAM per event queue slot
+#ifndef EVENTMANAGER_MPSC_QUEUE
+#define EVENTMANAGER_MPSC_QUEUE                 0
+#endif
+
+
+
+
+// Enable high and low watermark (flow control) callbacks on the event queues.
+// Requires 2 + sizeof(void*) + 1 bytes of RAM per event queue
+#ifndef EVENTMANAGER_QUEUE_WATERMARKS
+#define EVENTMANAGER_QUEUE_WATERMARKS           0
+#endif
+
+
+
+
+// Number of event timers (see setEventTimer()).  0 (the default) disables event timers.
+// Requires 3 * sizeof(int) + 3 bytes of RAM for each unit
+#ifndef EVENTMANAGER_NUM_TIMERS
+#define EVENTMANAGER_NUM_TIMERS                 0
+#endif
+
+#if EVENTMANAGER_NUM_TIMERS > 255
+#error "EVENTMANAGER_NUM_TIMERS exceeds size of a uint8_t"
+#endif
+
+
+
+
+// Enable putting the processor to sleep when processEvent() or processAllEvents() find nothing to do
+// (see enableIdleSleep()).  Requires 2 bytes of RAM
+#ifndef EVENTMANAGER_IDLE_SLEEP
+#define EVENTMANAGER_IDLE_SLEEP                 0
+#endif
+
+
+
+
+// Size of the low priority event backlog.  When non-zero, the low priority event queue
+// (EVENTMANAGER_EVENT_QUEUE_SIZE events) only buffers events between interrupts and the main loop,
+// and processEvent() moves them in bulk into this larger backlog, which is only touched by the
+// main loop.  0 (the default) disables the backlog.
+// Requires 2 * sizeof(int) bytes of RAM for each unit of size (plus 2 bytes with timestamps),
+// plus EVENTMANAGER_NUM_EVENT_CODES bytes with deduplication (twice that if the size is 255 or more)
+#ifndef EVENTMANAGER_BACKLOG_SIZE
+#define EVENTMANAGER_BACKLOG_SIZE               0
+#endif
+
+
+
+
+// Maximum number of per-source event queues (EventSource objects) that can be registered
+// with EventManager.  0 (the default) disables event sources.
+// Requires 2 + sizeof(void*) bytes of RAM for each unit of size
+#ifndef EVENTMANAGER_MAX_EVENT_SOURCES
+#define EVENTMANAGER_MAX_EVENT_SOURCES          0
+#endif
+
+#if EVENTMANAGER_MAX_EVENT_SOURCES > 255
+#error "EVENTMANAGER_MAX_EVENT_SOURCES exceeds size of a uint8_t"
+#endif
+
+
+// Number of events each EventSource can hold.
+// Each EventSource requires ( EVENTMANAGER_SOURCE_QUEUE_SIZE + 1 ) * 2 * sizeof(int) + 2 bytes of RAM
+#ifndef EVENTMANAGER_SOURCE_QUEUE_SIZE
+#define EVENTMANAGER_SOURCE_QUEUE_SIZE          4
+#endif
+
+#if EVENTMANAGER_SOURCE_QUEUE_SIZE > 254
+#error "EVENTMANAGER_SOURCE_QUEUE_SIZE exceeds size of a uint8_t"
+#endif
+
+
+
+
+// Enable the deadline-ordered (earliest-deadline-first) event queue.
+// Requires EVENTMANAGER_EVENT_QUEUE_SIZE * ( 2 * sizeof(int) + 2 ) additional bytes of RAM
+#ifndef EVENTMANAGER_DEADLINE_QUEUE
+#define EVENTMANAGER_DEADLINE_QUEUE             0
+#endif
+
+
+
+
 
 
 
@@ -150,236 +390,1439 @@ namespace EventManager
 
 
     /*!
-    * \brief Type for an event listener (a.k.a. callback) function.
+    * \brief A block of \c Count consecutive event codes starting at \c First, declared by a module.
     *
+    * A module declares its event codes as a block, either at a fixed first code or immediately
+    * after another module's block (see NextEventCodeBlock), and names them with code():
+    * \code
+    * typedef EventManager::EventCodeBlock< EventManager::kEventUser9 + 1, 2 > KeypadEvents;
+    * enum { kEventKeyRepeat = KeypadEvents::code< 0 >(), kEventKeyChord = KeypadEvents::code< 1 >() };
+    * \endcode
+    *
+    * Declaring the blocks in an event code registry (see EVENTMANAGER_EVENT_CODE_REGISTRY())
+    * checks at compile time that they do not conflict.
     */
 
-    typedef void ( *EventListener )( int eventCode, int eventParam );
+    template< int First, int Count >
+    struct EventCodeBlock
+    {
+        static_assert( First >= 0, "An event code block cannot start at a negative event code" );
+        static_assert( Count > 0, "An event code block must contain at least one event code" );
+
+        enum
+        {
+            kFirst = First,                 //!< The first event code in this block
+            kCount = Count,                 //!< The number of event codes in this block
+            kEnd = First + Count            //!< One past the last event code in this block
+        };
+
+        /*!
+        * \brief Return the Nth event code of this block.
+        *
+        * \arg \c N the index of the event code within the block, 0 to \c Count - 1; any other
+        * index fails the build rather than spilling into a neighbouring block.
+        *
+        * \returns The event code.
+        */
+
+        template< int N >
+        static constexpr int code()
+        {
+            static_assert( N >= 0 && N < Count, "Event code index is outside its event code block" );
+            return First + N;
+        }
+    };
 
 
 
     /*!
-    * \brief EventManager recognizes two kinds of events.  By default, events are
-    * are queued as low priority, but these constants can be used to explicitly
-    * set the priority when queueing events.
-    *
-    * \note High priority events are always handled before any low priority events.
+    * \brief A block of \c Count event codes starting immediately after the block \c Previous.
     *
-    * \hideinitializer
+    * Chaining blocks this way assigns dense event codes without any module having to pick numbers:
+    * \code
+    * typedef EventManager::NextEventCodeBlock< KeypadEvents, 1 > SensorEvents;
+    * \endcode
     */
 
-    enum EventPriority
+    template< typename Previous, int Count >
+    struct NextEventCodeBlock : EventCodeBlock< Previous::kEnd, Count >
     {
-        kHighPriority,
-        kLowPriority
     };
 
 
 
     /*!
-    * \brief Add an (event, listener) pair listener to the dispatch table.
+    * \brief A compile-time registry of the event code blocks used by an application.
     *
-    * \arg \c eventCode the event code this listener listens for.
-    * \arg \c listener the listener to be called when there is an event with this eventCode.
+    * The registry checks that its blocks, in the order listed, tile the event codes from \c First
+    * without gaps or overlaps, and that they all fit within the per-event-code tables
+    * (event codes below \c EVENTMANAGER_NUM_EVENT_CODES).  Two modules that claim the same
+    * event codes, or blocks listed out of order, fail the build.
     *
-    * \returns True if (the event, listener) pair is successfully installed in the dispatch table,
-    * false otherwise (e.g. the dispatch table is full).
+    * Declare a registry with EVENTMANAGER_EVENT_CODE_REGISTRY(), which runs the checks; a plain
+    * typedef of an EventCodeRegistry does not instantiate it, and so checks nothing.
+    *
+    * \note With the default \c EVENTMANAGER_NUM_EVENT_CODES of 40, only event codes
+    * \c kEventUser9 + 1 through 39 (three codes) are free for registered blocks.  Define
+    * \c EVENTMANAGER_NUM_EVENT_CODES to be larger if your blocks need more.
     */
 
-    bool addListener( int eventCode, EventListener listener );
+    template< int First, typename... Blocks >
+    struct EventCodeRegistry
+    {
+        enum
+        {
+            kFirst = First,                 //!< The first event code covered by the registry
+            kCount = 0,                     //!< The number of event codes covered by the registry
+            kEnd = First,                   //!< One past the last event code covered by the registry
+            kValid = 1                      //!< Non-zero; using it runs the registry's checks
+        };
+    };
+
+    template< int First, typename Block, typename... Blocks >
+    struct EventCodeRegistry< First, Block, Blocks... >
+    {
+        static_assert( Block::kFirst >= First, "Event code block overlaps the previous block (conflicting event codes)" );
+        static_assert( Block::kFirst <= First, "Event code block leaves a gap after the previous block (event codes not dense)" );
+        static_assert( Block::kEnd <= EVENTMANAGER_NUM_EVENT_CODES, "Event code block exceeds EVENTMANAGER_NUM_EVENT_CODES" );
+
+        enum
+        {
+            kFirst = First,
+            kEnd = EventCodeRegistry< Block::kEnd, Blocks... >::kEnd,
+            kCount = kEnd - First,
+            kValid = EventCodeRegistry< Block::kEnd, Blocks... >::kValid
+        };
+    };
 
 
 
     /*!
-    * \brief Remove this (event, listener) pair from the dispatch table.
-    * Other listener pairs with the same function or event code will not be affected.
-    *
-    * \arg \c eventCode the event code of the (event, listener) pair to be removed.
-    * \arg \c listener the listener of the (event, listener) pair to be removed.
+    * \brief Type for an event listener (a.k.a. callback) function.
     *
-    * \returns True if the (event, listener) pair is successfully removed, false otherwise.
     */
 
-    bool removeListener( int eventCode, EventListener listener );
+    typedef void ( *EventListener )( int eventCode, int eventParam );
 
 
 
     /*!
-    * \brief Remove all occurrances of a listener from the dispatch table, regardless of the event code.
-    * returns number removed.
-    *
-    * This function is useful when one listener handles many different events.
-    *
-    * \arg \c listener the listener to be removed.
-    *
-    * \returns The number of entries removed from the dispatch table.
+    * \brief Type for an event consumer, a listener that can stop further dispatch of an event.
     *
+    * A consumer returns true if it has fully handled (consumed) the event, in which case
+    * listeners with lower priority are not called for this event.  It returns false to let
+    * the event continue on to the remaining listeners.
     */
 
-    int removeListener( EventListener listener );
+    typedef bool ( *EventConsumer )( int eventCode, int eventParam );
+
 
 
+#if EVENTMANAGER_LISTENER_TABLES || EVENTMANAGER_SECTION_LISTENERS
 
     /*!
-    * \brief Enable or disable an (event, listener) pair entry in the dispatch table.
-    *
-    * \arg \c eventCode the event code of the (event, listener) pair to be enabled or disabled.
-    * \arg \c listener the listener of the (event, listener) pair to be enabled or disabled.
-    * \arg \c enable pass true to enable the (event, listener) pair, false to disable it.
+    * \brief An (event, listener) pair in a listener table (see setActiveListenerTable() and
+    * EVENTMANAGER_REGISTER_LISTENER()).
     *
-    * \returns True if the (event, listener) pair was successfully enabled or disabled,
-    * false if the (event, listener) pair was not found.
+    * \note Only available if \c EVENTMANAGER_LISTENER_TABLES or \c EVENTMANAGER_SECTION_LISTENERS
+    * is defined to be non-zero.
     */
 
-    bool enableListener( int eventCode, EventListener listener, bool enable );
+    struct ListenerTableEntry
+    {
+        int             eventCode;      //!< The event code this listener listens for
+        EventListener   listener;       //!< The listener to be called
+    };
+
+#endif
 
 
 
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
     /*!
-    * \brief Obtain the the current enabled/disabled state of an (eventCode, listener) pair.
+    * \brief Type for a batch listener, a listener that handles a run of events with the same code in one call.
     *
-    * \arg \c eventCode the event code of the (event, listener) pair.
-    * \arg \c listener the listener of the (event, listener) pair.
+    * \c eventParams points to the parameters of \c count consecutive events with code \c eventCode.
     *
-    *
-    * \returns The current enabled/disabled state of the (eventCode, listener) pair.
+    * \note Only available if \c EVENTMANAGER_MAX_BATCH_SIZE is defined to be non-zero.
     */
 
-    bool isListenerEnabled( int eventCode, EventListener listener );
+    typedef void ( *EventBatchListener )( int eventCode, const int* eventParams, uint8_t count );
+
+#endif
 
 
 
     /*!
-    * \brief Set a default listener.  The default listener is a callback function that is called when an
-    * event with no listener is processed.
+    * \brief EventManager recognizes two kinds of events.  By default, events are
+    * are queued as low priority, but these constants can be used to explicitly
+    * set the priority when queueing events.
     *
-    * \arg \c listener the listener to be set as the default listener.
+    * \note High priority events are always handled before any low priority events,
+    * unless a low priority service ratio is set with setLowPriorityServiceRatio().
     *
-    * \returns True if the default listener is successfully installed, false if \c listener is null.
+    * \hideinitializer
     */
 
-    bool setDefaultListener( EventListener listener );
+    enum EventPriority
+    {
+        kHighPriority,
+        kLowPriority
+    };
 
 
 
     /*!
-    * \brief Remvoes the default listener.  The default listener is a callback function that is called when an
-    * event with no listener is processed.
+    * \brief Type for a tick source, a function returning the current time as a free-running 16-bit tick count.
+    *
+    * The tick count is allowed to wrap around.  Any time unit can be used, for example milliseconds
+    * (a tick source could simply return the low 16 bits of \c millis()).
     */
 
-    void removeDefaultListener();
+    typedef uint16_t ( *TickSource )();
 
 
 
     /*!
-    * \brief Enable or disable the default listener.  The default listener is a callback function that is called when an
-    * event with no listener is processed.
+    * \brief Type for a flow control callback, called when an event queue crosses its watermarks.
     *
-    * \arg \c enable pass true to enable the default listener, false to disable it.
+    * \c throttle is true when the queue has filled up to its high watermark (producers should
+    * back off, e.g. by deasserting RTS or sending XOFF) and false when it has drained down
+    * to its low watermark (producers may resume).
     */
 
-    void enableDefaultListener( bool enable );
+    typedef void ( *QueueWatermarkCallback )( bool throttle );
 
 
 
     /*!
-    * \brief Check if the listener list (a.k.a., dispatch table) is empty.
+    * \brief Type for a tickless wakeup hook, which programs a hardware timer to wake the processor.
     *
-    * \returns True if the listener list (dispatch table) is empty, false if not.
+    * \c ticks is the number of ticks from now until the next event timer expires, or 0 if no
+    * event timer is running (in which case the hook should disable its wakeup interrupt).
     */
 
-    bool isListenerListEmpty();
+    typedef void ( *TicklessWakeupHook )( uint16_t ticks );
 
 
 
     /*!
-    * \brief Check if the listener list (a.k.a., dispatch table) is full.
+    * \brief Add an (event, listener) pair listener to the dispatch table.
     *
-    * \returns True if the listener list (dispatch table) is full, false if not.
+    * When an event is dispatched, its listeners are called in order of descending \c priority;
+    * listeners with equal priority are called in the order they were added.
+    *
+    * \arg \c eventCode the event code this listener listens for.
+    * \arg \c listener the listener to be called when there is an event with this eventCode.
+    * \arg \c group the listener group (0 to 7) this entry belongs to.  Defaults to 0.
+    * \arg \c priority the dispatch priority (-128 to 127) of this entry.  Defaults to 0.  Ignored (listeners
+    * are called in the order they were added) unless \c EVENTMANAGER_LISTENER_PRIORITIES is defined to be non-zero.
+    *
+    * \returns True if (the event, listener) pair is successfully installed in the dispatch table,
+    * false otherwise (e.g. the dispatch table is full or \c group is out of range).
     */
 
-    bool isListenerListFull();
+    bool addListener( int eventCode, EventListener listener, uint8_t group = 0, int8_t priority = 0 );
 
 
 
     /*!
-    * \brief Get the number of listeners in the dispatch table.
+    * \brief Add an (event, consumer) pair to the dispatch table.
     *
-    * \returns The number of entries in the listener list (a.k.a., dispatch table).
+    * Listeners for an event are called in order of descending \c priority (listeners with equal
+    * priority are called in the order they were added).  If a consumer returns true, the event is
+    * considered consumed and no further listeners are called for it.
+    *
+    * \arg \c eventCode the event code this consumer listens for.
+    * \arg \c consumer the consumer to be called when there is an event with this eventCode.
+    * \arg \c group the listener group (0 to 7) this entry belongs to.  Defaults to 0.
+    * \arg \c priority the dispatch priority (-128 to 127) of this entry.  Defaults to 0.  Ignored (listeners
+    * are called in the order they were added) unless \c EVENTMANAGER_LISTENER_PRIORITIES is defined to be non-zero.
+    *
+    * \returns True if (the event, consumer) pair is successfully installed in the dispatch table,
+    * false otherwise (e.g. the dispatch table is full or \c group is out of range).
     */
 
-    int numListeners();
+    bool addConsumingListener( int eventCode, EventConsumer consumer, uint8_t group = 0, int8_t priority = 0 );
 
 
 
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
     /*!
-    * \brief Check if the event queue is empty.
+    * \brief Add an (event, batch listener) pair to the dispatch table.
     *
-    * \arg \c pri the desired event queue: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    * processAllEvents() groups consecutive events with the same code into runs of up to
+    * \c EVENTMANAGER_MAX_BATCH_SIZE events, and calls a batch listener once per run with the
+    * parameters of all the events in it.  (processEvent() processes one event at a time, so it
+    * calls batch listeners with runs of one event.)  Other listeners for the same event code are
+    * still called once per event, and events consumed by higher priority consumers are left out
+    * of the run passed to lower priority listeners.
     *
-    * \returns True if the specified event queue is empty.
+    * Installing a batch listener changes the delivery order for every listener of its event code:
+    * a run is delivered one listener at a time, so a listener sees all of the events e1..en of a
+    * run before the next listener sees e1.  Also, processAllEvents() counts each listener once per
+    * run rather than once per event, so its return value is then no longer the number of calls.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_BATCH_SIZE is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code this batch listener listens for.
+    * \arg \c listener the batch listener to be called when there are events with this eventCode.
+    * \arg \c group the listener group (0 to 7) this entry belongs to.  Defaults to 0.
+    * \arg \c priority the dispatch priority (-128 to 127) of this entry.  Defaults to 0.  Ignored (listeners
+    * are called in the order they were added) unless \c EVENTMANAGER_LISTENER_PRIORITIES is defined to be non-zero.
+    *
+    * \returns True if (the event, batch listener) pair is successfully installed in the dispatch table,
+    * false otherwise (e.g. the dispatch table is full or \c group is out of range).
     */
 
-    bool isEventQueueEmpty( EventPriority pri = kLowPriority );
+    bool addBatchListener( int eventCode, EventBatchListener listener, uint8_t group = 0, int8_t priority = 0 );
+
+#endif
 
 
 
     /*!
-    * \brief Check if the event queue is full.
+    * \brief Add a one-shot (event, listener) pair to the dispatch table.
     *
-    * \arg \c pri the desired event queue: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    * A one-shot listener is removed from the dispatch table automatically after it is called
+    * for the first time.  This is useful, for example, for a listener waiting for a single reply.
+    * The entry is retired before the listener is called, so the listener may re-install itself,
+    * even if the dispatch table is full; like any listener added during dispatch, the new entry
+    * applies from the next event on.
     *
-    * \returns True if the specified event queue is full.
+    * \arg \c eventCode the event code this listener listens for.
+    * \arg \c listener the listener to be called (once) when there is an event with this eventCode.
+    * \arg \c group the listener group (0 to 7) this entry belongs to.  Defaults to 0.
+    * \arg \c priority the dispatch priority (-128 to 127) of this entry.  Defaults to 0.  Ignored (listeners
+    * are called in the order they were added) unless \c EVENTMANAGER_LISTENER_PRIORITIES is defined to be non-zero.
+    *
+    * \returns True if (the event, listener) pair is successfully installed in the dispatch table,
+    * false otherwise (e.g. the dispatch table is full or \c group is out of range).
     */
 
-    bool isEventQueueFull( EventPriority pri = kLowPriority );
+    bool addOneShotListener( int eventCode, EventListener listener, uint8_t group = 0, int8_t priority = 0 );
+
 
 
+#if EVENTMANAGER_RANGE_LISTENERS
 
     /*!
-    * \brief Get the number of events in the event queue.
+    * \brief Add a listener for a contiguous range of event codes to the dispatch table.
     *
-    * \arg \c pri the desired event queue: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    * The listener is called for every event whose code lies between \c loEventCode and \c hiEventCode
+    * (inclusive).  A range listener occupies a single entry in the dispatch table, no matter how many
+    * event codes the range spans (e.g., kEventMenu0 through kEventMenu9).
     *
-    * \returns The number of events in the specified event queue.
+    * \note Only available if \c EVENTMANAGER_RANGE_LISTENERS is defined to be non-zero.
+    *
+    * \arg \c loEventCode the lowest event code this listener listens for.
+    * \arg \c hiEventCode the highest event code this listener listens for.
+    * \arg \c listener the listener to be called when there is an event with a code in the range.
+    * \arg \c group the listener group (0 to 7) this entry belongs to.  Defaults to 0.
+    * \arg \c priority the dispatch priority (-128 to 127) of this entry.  Defaults to 0.  Ignored (listeners
+    * are called in the order they were added) unless \c EVENTMANAGER_LISTENER_PRIORITIES is defined to be non-zero.
+    *
+    * \returns True if the range listener is successfully installed in the dispatch table,
+    * false otherwise (e.g. the dispatch table is full, \c group is out of range, or \c loEventCode > \c hiEventCode).
     */
 
-    int getNumEventsInQueue( EventPriority pri = kLowPriority );
+    bool addRangeListener( int loEventCode, int hiEventCode, EventListener listener, uint8_t group = 0, int8_t priority = 0 );
 
 
 
     /*!
-    * \brief Tries to add an event into the event queue.
+    * \brief Remove this (range, listener) entry from the dispatch table.
     *
-    * \arg \c eventCode  identifies the event to be added.
-    * \arg \c eventParam  an integer parameter associated with this event.
-    * \arg \c pri specifies which queue gets the event: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    * \arg \c loEventCode the lowest event code of the range listener to be removed.
+    * \arg \c hiEventCode the highest event code of the range listener to be removed.
+    * \arg \c listener the listener of the range entry to be removed.
     *
-    * \returns True if successful; false if the queue is full and the event cannot be added.
+    * \returns True if the range entry is successfully removed, false otherwise.
     */
 
-    bool queueEvent( int eventCode, int eventParam, EventPriority pri = kLowPriority );
+    bool removeRangeListener( int loEventCode, int hiEventCode, EventListener listener );
 
 
 
     /*!
-    * \brief Processes one event from the event queue and
-    * dispatches it to the corresponding listeners stored in the dispatch table.
+    * \brief Add a listener for a family of event codes selected by a bit mask to the dispatch table.
     *
-    * Events are taken preferentially from the high priority queue.  If the high priority queue is empty,
-    * then events are taken from the low prioirty queue.
-    *
-    * All listeners associated with the event that are enabled will be called.  Disabled listeners are not called.
+    * The listener is called for every event whose code satisfies <tt>( eventCode & eventMask ) == eventValue</tt>.
+    * A mask listener occupies a single entry in the dispatch table.
     *
-    * The event processed is removed from the event queue (even if there is no listener to handle it).
+    * \note Only available if \c EVENTMANAGER_RANGE_LISTENERS is defined to be non-zero.
     *
-    * \note This function should be called regularly to keep the event queues from getting full.  This is usually
-    * done by calling it inside an event processing loop.
+    * \arg \c eventMask the bits of the event code that are compared.
+    * \arg \c eventValue the value the masked event code must equal.
+    * \arg \c listener the listener to be called when there is an event with a matching code.
+    * \arg \c group the listener group (0 to 7) this entry belongs to.  Defaults to 0.
+    * \arg \c priority the dispatch priority (-128 to 127) of this entry.  Defaults to 0.  Ignored (listeners
+    * are called in the order they were added) unless \c EVENTMANAGER_LISTENER_PRIORITIES is defined to be non-zero.
     *
-    * \returns The number of event handlers called.
+    * \returns True if the mask listener is successfully installed in the dispatch table,
+    * false otherwise (e.g. the dispatch table is full or \c group is out of range).
     */
 
-    int processEvent();
+    bool addMaskListener( int eventMask, int eventValue, EventListener listener, uint8_t group = 0, int8_t priority = 0 );
+
+
+
+    /*!
+    * \brief Remove this (mask, listener) entry from the dispatch table.
+    *
+    * \arg \c eventMask the mask of the mask listener to be removed.
+    * \arg \c eventValue the value of the mask listener to be removed.
+    * \arg \c listener the listener of the mask entry to be removed.
+    *
+    * \returns True if the mask entry is successfully removed, false otherwise.
+    */
+
+    bool removeMaskListener( int eventMask, int eventValue, EventListener listener );
+
+#endif
+
+
+
+    /*!
+    * \brief Remove this (event, listener) pair from the dispatch table.
+    * Other listener pairs with the same function or event code will not be affected.
+    *
+    * It is safe to call this function from within a listener (e.g., for a listener to remove itself);
+    * entries removed while an event is being dispatched are compacted out once dispatch completes.
+    *
+    * \arg \c eventCode the event code of the (event, listener) pair to be removed.
+    * \arg \c listener the listener of the (event, listener) pair to be removed.
+    *
+    * \returns True if the (event, listener) pair is successfully removed, false otherwise.
+    */
+
+    bool removeListener( int eventCode, EventListener listener );
+
+
+
+    /*!
+    * \brief Remove this (event, consumer) pair from the dispatch table.
+    *
+    * \arg \c eventCode the event code of the (event, consumer) pair to be removed.
+    * \arg \c consumer the consumer of the (event, consumer) pair to be removed.
+    *
+    * \returns True if the (event, consumer) pair is successfully removed, false otherwise.
+    */
+
+    bool removeListener( int eventCode, EventConsumer consumer );
+
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+    /*!
+    * \brief Remove this (event, batch listener) pair from the dispatch table.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_BATCH_SIZE is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code of the (event, batch listener) pair to be removed.
+    * \arg \c listener the batch listener of the (event, batch listener) pair to be removed.
+    *
+    * \returns True if the (event, batch listener) pair is successfully removed, false otherwise.
+    */
+
+    bool removeListener( int eventCode, EventBatchListener listener );
+
+#endif
+
+
+
+    /*!
+    * \brief Remove all occurrances of a listener from the dispatch table, regardless of the event code.
+    * returns number removed.
+    *
+    * This function is useful when one listener handles many different events.  Range and mask
+    * entries for this listener are removed as well.
+    *
+    * \arg \c listener the listener to be removed.
+    *
+    * \returns The number of entries removed from the dispatch table.
+    *
+    */
+
+    int removeListener( EventListener listener );
+
+
+
+    /*!
+    * \brief Remove all occurrances of a consumer from the dispatch table, regardless of the event code.
+    *
+    * \arg \c consumer the consumer to be removed.
+    *
+    * \returns The number of entries removed from the dispatch table.
+    */
+
+    int removeListener( EventConsumer consumer );
+
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+    /*!
+    * \brief Remove all occurrances of a batch listener from the dispatch table, regardless of the event code.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_BATCH_SIZE is defined to be non-zero.
+    *
+    * \arg \c listener the batch listener to be removed.
+    *
+    * \returns The number of entries removed from the dispatch table.
+    */
+
+    int removeListener( EventBatchListener listener );
+
+#endif
+
+
+
+    /*!
+    * \brief Enable or disable an (event, listener) pair entry in the dispatch table.
+    *
+    * \arg \c eventCode the event code of the (event, listener) pair to be enabled or disabled.
+    * \arg \c listener the listener of the (event, listener) pair to be enabled or disabled.
+    * \arg \c enable pass true to enable the (event, listener) pair, false to disable it.
+    *
+    * \returns True if the (event, listener) pair was successfully enabled or disabled,
+    * false if the (event, listener) pair was not found.
+    */
+
+    bool enableListener( int eventCode, EventListener listener, bool enable );
+
+
+
+    /*!
+    * \brief Enable or disable an (event, consumer) pair entry in the dispatch table.
+    *
+    * \arg \c eventCode the event code of the (event, consumer) pair to be enabled or disabled.
+    * \arg \c consumer the consumer of the (event, consumer) pair to be enabled or disabled.
+    * \arg \c enable pass true to enable the (event, consumer) pair, false to disable it.
+    *
+    * \returns True if the (event, consumer) pair was successfully enabled or disabled,
+    * false if the (event, consumer) pair was not found.
+    */
+
+    bool enableListener( int eventCode, EventConsumer consumer, bool enable );
+
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+    /*!
+    * \brief Enable or disable an (event, batch listener) pair entry in the dispatch table.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_BATCH_SIZE is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code of the (event, batch listener) pair to be enabled or disabled.
+    * \arg \c listener the batch listener of the (event, batch listener) pair to be enabled or disabled.
+    * \arg \c enable pass true to enable the (event, batch listener) pair, false to disable it.
+    *
+    * \returns True if the (event, batch listener) pair was successfully enabled or disabled,
+    * false if the (event, batch listener) pair was not found.
+    */
+
+    bool enableListener( int eventCode, EventBatchListener listener, bool enable );
+
+#endif
+
+
+
+    /*!
+    * \brief Obtain the the current enabled/disabled state of an (eventCode, listener) pair.
+    *
+    * \arg \c eventCode the event code of the (event, listener) pair.
+    * \arg \c listener the listener of the (event, listener) pair.
+    *
+    *
+    * \returns The current enabled/disabled state of the (eventCode, listener) pair.
+    */
+
+    bool isListenerEnabled( int eventCode, EventListener listener );
+
+
+
+    /*!
+    * \brief Enable or disable an entire listener group.
+    *
+    * Every dispatch table entry belongs to one of eight listener groups (group 0 unless
+    * specified otherwise when the listener was added).  Disabling a group suppresses all
+    * of its entries at once, in addition to the per-entry enabled/disabled state set with
+    * enableListener().  All groups are enabled initially.
+    *
+    * \arg \c group the listener group (0 to 7) to be enabled or disabled.
+    * \arg \c enable pass true to enable the group, false to disable it.
+    */
+
+    void enableListenerGroup( uint8_t group, bool enable );
+
+
+
+    /*!
+    * \brief Enable and disable all listener groups in one operation.
+    *
+    * This is useful for switching between application modes: each bit of \c groupMask
+    * corresponds to one listener group (bit 0 to group 0, and so on).
+    *
+    * \arg \c groupMask the listener groups to be enabled; groups with a zero bit are disabled.
+    */
+
+    void setEnabledListenerGroups( uint8_t groupMask );
+
+
+
+    /*!
+    * \brief Obtain the current enabled/disabled state of a listener group.
+    *
+    * \arg \c group the listener group (0 to 7).
+    *
+    * \returns True if the group is enabled, false if it is disabled (or out of range).
+    */
+
+    bool isListenerGroupEnabled( uint8_t group );
+
+
+
+#if EVENTMANAGER_LISTENER_TABLES
+
+    /*!
+    * \brief Select the listener table that is consulted, along with the dispatch table, when events are dispatched.
+    *
+    * A listener table is a fixed array of (event, listener) pairs built ahead of time, for instance
+    * one per screen or mode of the application.  Switching between them only swaps a pointer, instead
+    * of removing and adding the listeners one by one.  The dispatch table (managed with addListener()
+    * and friends) stays active all the time, as a base table shared by every mode: when an event is
+    * dispatched, its listeners in the dispatch table are called first, then those in the active
+    * listener table, in table order.  An event consumed by a consumer in the dispatch table is not
+    * passed to the listener table.
+    *
+    * Listener tables can be kept in flash, to save RAM:
+    * \code
+    * const EventManager::ListenerTableEntry kMenuScreen[] PROGMEM =
+    * {
+    *     { EventManager::kEventKeyPress, menuKeyListener },
+    *     { EventManager::kEventMenu0,    menuListener }
+    * };
+    *
+    * EventManager::setActiveListenerTable( kMenuScreen, 2, true );
+    * \endcode
+    *
+    * The table must remain valid for as long as it is active.
+    *
+    * \note Only available if \c EVENTMANAGER_LISTENER_TABLES is defined to be non-zero.
+    *
+    * \arg \c table the listener table, or null for none (the default).
+    * \arg \c numEntries the number of entries in \c table.
+    * \arg \c inFlash true if \c table is stored in flash (declared \c PROGMEM).  Defaults to false.
+    */
+
+    void setActiveListenerTable( const ListenerTableEntry* table, uint8_t numEntries, bool inFlash = false );
+
+#endif
+
+
+
+    /*!
+    * \brief Set a default listener.  The default listener is a callback function that is called when an
+    * event with no listener is processed.
+    *
+    * \arg \c listener the listener to be set as the default listener.
+    *
+    * \returns True if the default listener is successfully installed, false if \c listener is null.
+    */
+
+    bool setDefaultListener( EventListener listener );
+
+
+
+    /*!
+    * \brief Remvoes the default listener.  The default listener is a callback function that is called when an
+    * event with no listener is processed.
+    */
+
+    void removeDefaultListener();
+
+
+
+    /*!
+    * \brief Enable or disable the default listener.  The default listener is a callback function that is called when an
+    * event with no listener is processed.
+    *
+    * \arg \c enable pass true to enable the default listener, false to disable it.
+    */
+
+    void enableDefaultListener( bool enable );
+
+
+
+    /*!
+    * \brief Check if the listener list (a.k.a., dispatch table) is empty.
+    *
+    * \returns True if the listener list (dispatch table) is empty, false if not.
+    */
+
+    bool isListenerListEmpty();
+
+
+
+    /*!
+    * \brief Check if the listener list (a.k.a., dispatch table) is full.
+    *
+    * \returns True if the listener list (dispatch table) is full, false if not.
+    */
+
+    bool isListenerListFull();
+
+
+
+    /*!
+    * \brief Get the number of listeners in the dispatch table.
+    *
+    * \returns The number of entries in the listener list (a.k.a., dispatch table).
+    */
+
+    int numListeners();
+
+
+
+    /*!
+    * \brief Check if the event queue is empty.
+    *
+    * \arg \c pri the desired event queue: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    *
+    * \returns True if the specified event queue is empty.
+    */
+
+    bool isEventQueueEmpty( EventPriority pri = kLowPriority );
+
+
+
+    /*!
+    * \brief Check if the event queue is full.
+    *
+    * \arg \c pri the desired event queue: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    *
+    * \returns True if the specified event queue is full.
+    */
+
+    bool isEventQueueFull( EventPriority pri = kLowPriority );
+
+
+
+    /*!
+    * \brief Get the number of events in the event queue.
+    *
+    * \arg \c pri the desired event queue: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    *
+    * \returns The number of events in the specified event queue.
+    */
+
+    int getNumEventsInQueue( EventPriority pri = kLowPriority );
+
+
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+
+    /*!
+    * \brief Set the flow control watermarks of an event queue.
+    *
+    * \c callback is called with \c true by the queueEvent() call that brings the number of events
+    * in the queue up to \c highWatermark, and then with \c false by the event processing that
+    * brings it back down to \c lowWatermark.  The callback runs outside EventManager's own atomic
+    * sections, but in the context of its caller: when queueEvent() is called from an interrupt
+    * handler, the callback runs inside that interrupt handler, with interrupts still disabled.
+    * It must therefore be short and safe to call from an interrupt handler.
+    *
+    * \note Only available if \c EVENTMANAGER_QUEUE_WATERMARKS is defined to be 1.
+    *
+    * \arg \c pri specifies the queue: kLowPriority or kHighPriority.
+    * \arg \c highWatermark number of events at which the queue asks producers to back off
+    * (0 disables the callbacks).
+    * \arg \c lowWatermark number of events at which the queue lets producers resume.
+    * \arg \c callback the flow control callback.
+    *
+    * \returns True if successful; false if \c lowWatermark is not less than \c highWatermark
+    * or \c highWatermark exceeds the queue size.
+    */
+
+    bool setEventQueueWatermarks( EventPriority pri, uint8_t highWatermark, uint8_t lowWatermark,
+                                  QueueWatermarkCallback callback );
+
+#endif
+
+
+
+    /*!
+    * \brief Tries to add an event into the event queue.
+    *
+    * \arg \c eventCode  identifies the event to be added.
+    * \arg \c eventParam  an integer parameter associated with this event.
+    * \arg \c pri specifies which queue gets the event: kLowPriority or kHighPriority.
+    *
+    * \returns True if successful; false if the queue is full and the event cannot be added
+    * (or if the event is rejected by a rate limit, see setEventRateLimit()).
+    */
+
+    bool queueEvent( int eventCode, int eventParam, EventPriority pri );
+
+
+
+    /*!
+    * \brief Tries to add an event into the event queue for its event code's default priority.
+    *
+    * The default priority of every event code is kLowPriority, unless changed with
+    * setDefaultEventPriority().
+    *
+    * \arg \c eventCode  identifies the event to be added.
+    * \arg \c eventParam  an integer parameter associated with this event.
+    *
+    * \returns True if successful; false if the queue is full and the event cannot be added
+    * (or if the event is rejected by a rate limit, see setEventRateLimit()).
+    */
+
+    bool queueEvent( int eventCode, int eventParam );
+
+
+
+    /*!
+    * \brief Set the source of time used by EventManager features that need it (such as event deadlines).
+    *
+    * Without a tick source, EventManager treats the current time as always being 0.
+    *
+    * \arg \c source the tick source, or null to remove the tick source.
+    */
+
+    void setTickSource( TickSource source );
+
+
+
+#if EVENTMANAGER_NUM_TIMERS
+
+    /*!
+    * \brief Start (or restart) a timer that queues a low priority event when it expires.
+    *
+    * Timers are checked by processEvent() and processAllEvents() against the tick source
+    * (see setTickSource()); an expired timer queues its event into the low priority queue.
+    * There is at most one timer per event code: setting a timer for an event code that
+    * already has one replaces that timer.
+    *
+    * \note Only available if \c EVENTMANAGER_NUM_TIMERS is defined to be non-zero.
+    *
+    * \arg \c eventCode  identifies the event to be queued.
+    * \arg \c eventParam  an integer parameter associated with this event.
+    * \arg \c delay the number of ticks from now until the timer expires (less than 32768).
+    * \arg \c period if non-zero, the timer restarts with this period after it expires.  Defaults to 0 (one-shot).
+    *
+    * \returns True if successful; false if all \c EVENTMANAGER_NUM_TIMERS timers are in use.
+    */
+
+    bool setEventTimer( int eventCode, int eventParam, uint16_t delay, uint16_t period = 0 );
+
+
+
+    /*!
+    * \brief Stop the timer for an event code.
+    *
+    * \note Only available if \c EVENTMANAGER_NUM_TIMERS is defined to be non-zero.
+    *
+    * \arg \c eventCode  the event code whose timer is stopped.
+    *
+    * \returns True if successful; false if no timer is running for \c eventCode.
+    */
+
+    bool cancelEventTimer( int eventCode );
+
+#endif
+
+
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+
+    /*!
+    * \brief Tries to add an event with a deadline into the deadline-ordered event queue.
+    *
+    * Events in the deadline queue are processed in order of their deadlines (earliest first), and
+    * ahead of any events in the high and low priority queues.  The deadline is relative to the
+    * current time reported by the tick source (see setTickSource()), and must be less than 32768 ticks.
+    *
+    * Like queueEvent(), this function is interrupt safe.
+    *
+    * \note Only available if \c EVENTMANAGER_DEADLINE_QUEUE is defined to be non-zero.
+    *
+    * \arg \c eventCode  identifies the event to be added.
+    * \arg \c eventParam  an integer parameter associated with this event.
+    * \arg \c deadline the number of ticks from now within which the event should be processed.
+    *
+    * \returns True if successful; false if the deadline queue is full and the event cannot be added.
+    */
+
+    bool queueEventWithDeadline( int eventCode, int eventParam, uint16_t deadline );
+
+
+
+    /*!
+    * \brief Get the number of events in the deadline-ordered event queue.
+    *
+    * \note Only available if \c EVENTMANAGER_DEADLINE_QUEUE is defined to be non-zero.
+    *
+    * \returns The number of events in the deadline queue.
+    */
+
+    int getNumEventsInDeadlineQueue();
+
+#endif
+
+
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+
+    /*!
+    * \brief Set the time-to-live of events with a given event code.
+    *
+    * Events are timestamped (using the tick source, see setTickSource()) when they are queued.  An
+    * event that has been waiting in a queue for longer than its time-to-live when it reaches the
+    * front of the queue is discarded without being dispatched.
+    *
+    * \note Only available if \c EVENTMANAGER_EVENT_TIMESTAMPS is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code (0 to \c EVENTMANAGER_NUM_EVENT_CODES - 1).
+    * \arg \c ttl the time-to-live in ticks, or 0 if these events never expire (the default).
+    *
+    * \returns True if successful; false if \c eventCode is out of range.
+    */
+
+    bool setEventTimeToLive( int eventCode, uint16_t ttl );
+
+
+
+    /*!
+    * \brief Get how long the event currently being dispatched waited in its queue.
+    *
+    * Call this from within a listener to find out how stale the event is.
+    *
+    * \note Only available if \c EVENTMANAGER_EVENT_TIMESTAMPS is defined to be non-zero.
+    *
+    * \returns The number of ticks since the event being dispatched was queued.
+    */
+
+    uint16_t getEventAge();
+
+#endif
+
+
+
+#if EVENTMANAGER_RATE_LIMITS
+
+    /*!
+    * \brief Limit the rate at which events with a given event code can be queued.
+    *
+    * Each rate-limited event code has a token bucket holding up to \c burst tokens.  Queuing an
+    * event with that code takes a token; if the bucket is empty the event is rejected (queueEvent()
+    * returns false) without touching the event queue.  An event that takes no room in the queue
+    * (because the queue is full, or it is merged with an identical pending event) gives its token
+    * back.  Each call to refillEventRateLimits() adds \c refill tokens to the bucket.  The bucket
+    * starts out full.
+    *
+    * \note Only available if \c EVENTMANAGER_RATE_LIMITS is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code (0 to \c EVENTMANAGER_NUM_EVENT_CODES - 1).
+    * \arg \c refill the number of tokens added by each call to refillEventRateLimits().
+    * \arg \c burst the capacity of the bucket, or 0 to remove the rate limit (the default).
+    *
+    * \returns True if successful; false if \c eventCode is out of range.
+    */
+
+    bool setEventRateLimit( int eventCode, uint8_t refill, uint8_t burst );
+
+
+
+    /*!
+    * \brief Refill the rate limit token buckets.
+    *
+    * Call this function at a regular interval, for example from a timer interrupt handler.  The
+    * allowed sustained rate of each rate-limited event code is its \c refill tokens per call.
+    * This function is interrupt safe.
+    *
+    * \note Only available if \c EVENTMANAGER_RATE_LIMITS is defined to be non-zero.
+    */
+
+    void refillEventRateLimits();
+
+
+
+    /*!
+    * \brief Get the number of events with a given event code that were rejected by its rate limit.
+    *
+    * The count saturates at 65535.
+    *
+    * \note Only available if \c EVENTMANAGER_RATE_LIMITS is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code (0 to \c EVENTMANAGER_NUM_EVENT_CODES - 1).
+    *
+    * \returns The number of rejected events (0 if \c eventCode is out of range).
+    */
+
+    uint16_t getNumRateLimitedEvents( int eventCode );
+
+
+
+    /*!
+    * \brief Reset the counts of events rejected by rate limits to zero for all event codes.
+    *
+    * \note Only available if \c EVENTMANAGER_RATE_LIMITS is defined to be non-zero.
+    */
+
+    void clearNumRateLimitedEvents();
+
+#endif
+
+
+
+#if EVENTMANAGER_NUM_JOINS
+
+    /*!
+    * \brief Add a join, which queues a completion event once each of a set of events has been processed.
+    *
+    * The set of awaited event codes is given as a bit mask relative to \c firstEventCode: bit \e n of
+    * \c codeMask set means event code \c firstEventCode + \e n is awaited.  Once every awaited event
+    * code has been processed (in any order, any number of times), the join queues the completion event
+    * and starts waiting for the whole set again.  The awaited events are still dispatched to their
+    * listeners as usual.
+    *
+    * For example, to be told when all six analog channels have been sampled:
+    * \code
+    * EventManager::addEventJoin( EventManager::kEventAnalog0, 0x3F, kEventAllSampled );
+    * \endcode
+    *
+    * \note Only available if \c EVENTMANAGER_NUM_JOINS is defined to be non-zero.
+    *
+    * \arg \c firstEventCode the event code corresponding to bit 0 of \c codeMask.
+    * \arg \c codeMask the awaited event codes (must not be 0).
+    * \arg \c completionEventCode the code of the completion event.
+    * \arg \c completionEventParam the parameter of the completion event.  Defaults to 0.
+    * \arg \c pri specifies which queue gets the completion event: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    *
+    * \returns True if successful; false if \c codeMask is 0 or all \c EVENTMANAGER_NUM_JOINS joins are in use.
+    */
+
+    bool addEventJoin( int firstEventCode, uint16_t codeMask, int completionEventCode,
+                       int completionEventParam = 0, EventPriority pri = kLowPriority );
+
+
+
+    /*!
+    * \brief Remove the joins with a given completion event code.
+    *
+    * \note Only available if \c EVENTMANAGER_NUM_JOINS is defined to be non-zero.
+    *
+    * \arg \c completionEventCode the completion event code of the joins to be removed.
+    *
+    * \returns The number of joins removed.
+    */
+
+    int removeEventJoin( int completionEventCode );
+
+#endif
+
+
+
+#if EVENTMANAGER_EVENT_COUNTERS
+
+    /*!
+    * \brief Make an event code counter-only, or restore it to a normal event code.
+    *
+    * Events with a counter-only event code are not queued: queueEvent() (and queueEventWithDeadline())
+    * just increment a counter for the event code, which saturates at 65535, and return true.
+    * The event parameter is ignored.  Read the count with readAndClearEventCount(), or have it
+    * delivered as a single event with postEventCount().
+    *
+    * \note Only available if \c EVENTMANAGER_EVENT_COUNTERS is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code (0 to \c EVENTMANAGER_NUM_EVENT_CODES - 1).
+    * \arg \c enable pass true to make the event code counter-only, false to make it a normal event code (the default).
+    *
+    * \returns True if successful; false if \c eventCode is out of range.
+    */
+
+    bool enableEventCounter( int eventCode, bool enable );
+
+
+
+    /*!
+    * \brief Get the number of events counted for a counter-only event code, and reset the count to 0.
+    *
+    * \note Only available if \c EVENTMANAGER_EVENT_COUNTERS is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code.
+    *
+    * \returns The number of events counted since the count was last reset (0 if \c eventCode is out of range).
+    */
+
+    uint16_t readAndClearEventCount( int eventCode );
+
+
+
+    /*!
+    * \brief Queue a single summary event carrying the count of a counter-only event code, and reset the count.
+    *
+    * The event queued has code \c eventCode and the count (as an unsigned value) as its parameter.
+    * Nothing is queued if the count is 0.
+    *
+    * \note Only available if \c EVENTMANAGER_EVENT_COUNTERS is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code.
+    * \arg \c pri specifies which queue gets the event: kLowPriority or kHighPriority.  Defaults to kLowPriority.
+    *
+    * \returns True if a summary event was queued; false if the count is 0 or the queue is full
+    * (in which case the count is kept).
+    */
+
+    bool postEventCount( int eventCode, EventPriority pri = kLowPriority );
+
+#endif
+
+
+
+#if EVENTMANAGER_DEDUPLICATION
+
+    /*!
+    * \brief Enable or disable deduplication of pending events with a given event code.
+    *
+    * If deduplication is enabled for an event code, queueEvent() does not queue an event if the
+    * most recently queued event with that code is identical (same event parameter) and is still
+    * waiting in the same queue.  In that case queueEvent() returns true, because the pending event
+    * will be processed.  The check takes constant time, so it is cheap even from interrupt handlers.
+    *
+    * \note Only available if \c EVENTMANAGER_DEDUPLICATION is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code (0 to \c EVENTMANAGER_NUM_EVENT_CODES - 1).
+    * \arg \c enable pass true to enable deduplication, false to disable it (the default).
+    *
+    * \returns True if successful; false if \c eventCode is out of range.
+    */
+
+    bool enableEventDeduplication( int eventCode, bool enable );
+
+#endif
+
+
+
+#if EVENTMANAGER_DEFAULT_PRIORITIES
+
+    /*!
+    * \brief Set the priority of events queued with an event code when no priority is given.
+    *
+    * This lets the priority policy be set in one place, for example making sure safety related
+    * events queued by interrupt handlers always go into the high priority queue.
+    *
+    * \note Only available if \c EVENTMANAGER_DEFAULT_PRIORITIES is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code (0 to \c EVENTMANAGER_NUM_EVENT_CODES - 1).
+    * \arg \c pri the default priority: kLowPriority (the default) or kHighPriority.
+    *
+    * \returns True if successful; false if \c eventCode is out of range.
+    */
+
+    bool setDefaultEventPriority( int eventCode, EventPriority pri );
+
+
+
+    /*!
+    * \brief Get the priority of events queued with an event code when no priority is given.
+    *
+    * \note Only available if \c EVENTMANAGER_DEFAULT_PRIORITIES is defined to be non-zero.
+    *
+    * \arg \c eventCode the event code.
+    *
+    * \returns The default priority of \c eventCode (kLowPriority if \c eventCode is out of range).
+    */
+
+    EventPriority getDefaultEventPriority( int eventCode );
+
+#endif
+
+
+
+#if EVENTMANAGER_PAINT_SCHEDULER
+
+    /*!
+    * \brief Mark a region of the display as needing to be repainted.
+    *
+    * Rather than queuing a kEventPaint event for every change, call this function.  Invalidated
+    * regions are merged into a single bounding box, and the paint scheduler queues (as a low
+    * priority event) at most one kEventPaint event per frame interval (see setPaintInterval()).
+    * The listener for kEventPaint obtains the region to repaint by calling getPaintRegion().
+    *
+    * This function is interrupt safe.
+    *
+    * \note Only available if \c EVENTMANAGER_PAINT_SCHEDULER is defined to be non-zero.
+    *
+    * \arg \c x0 the left edge of the region.
+    * \arg \c y0 the top edge of the region.
+    * \arg \c x1 the right edge of the region.
+    * \arg \c y1 the bottom edge of the region.
+    */
+
+    void invalidateRegion( int x0, int y0, int x1, int y1 );
+
+
+
+    /*!
+    * \brief Obtain (and clear) the region of the display that needs to be repainted.
+    *
+    * Call this from the kEventPaint listener.
+    *
+    * \note Only available if \c EVENTMANAGER_PAINT_SCHEDULER is defined to be non-zero.
+    *
+    * \arg \c x0 receives the left edge of the region.
+    * \arg \c y0 receives the top edge of the region.
+    * \arg \c x1 receives the right edge of the region.
+    * \arg \c y1 receives the bottom edge of the region.
+    *
+    * \returns True if there is a region to repaint; false if nothing has been invalidated
+    * (the arguments are not touched in this case).
+    */
+
+    bool getPaintRegion( int* x0, int* y0, int* x1, int* y1 );
+
+
+
+    /*!
+    * \brief Set the minimum interval between kEventPaint events queued by the paint scheduler.
+    *
+    * The interval is measured using the tick source (see setTickSource()).  The default is 0,
+    * which still collapses repeated invalidations into a single pending kEventPaint event.
+    *
+    * \note Only available if \c EVENTMANAGER_PAINT_SCHEDULER is defined to be non-zero.
+    *
+    * \arg \c ticks the frame interval in ticks.
+    */
+
+    void setPaintInterval( uint16_t ticks );
+
+#endif
+
+
+
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+
+    /*!
+    * \brief A small event queue owned by a single producer (typically one interrupt handler).
+    *
+    * An EventSource is a single-producer, single-consumer ring buffer, so queuing an event into it
+    * needs no interrupt masking at all.  Register the EventSource with EventManager using
+    * addEventSource(); processEvent() and processAllEvents() then merge the events from all
+    * registered sources (after high priority events and before low priority events), according
+    * to the policy set by setEventSourcePolicy().
+    *
+    * Each EventSource holds up to \c EVENTMANAGER_SOURCE_QUEUE_SIZE events.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_EVENT_SOURCES is defined to be non-zero.
+    */
+
+    class EventSource
+    {
+
+    public:
+
+        /*!
+        * \brief Construct an empty EventSource.
+        *
+        * The constructor is \c constexpr, so a global EventSource is initialized without any code
+        * running before \c main().
+        */
+
+        constexpr EventSource();
+
+        /*!
+        * \brief Tries to add an event into this EventSource.
+        *
+        * \note Only one context (one interrupt handler, or the main code) may queue events into
+        * a given EventSource.
+        *
+        * \arg \c eventCode  identifies the event to be added.
+        * \arg \c eventParam  an integer parameter associated with this event.
+        *
+        * \returns True if successful; false if the EventSource is full and the event cannot be added.
+        */
+
+        bool queueEvent( int eventCode, int eventParam );
+
+        /*!
+        * \brief Check if this EventSource is empty.
+        *
+        * \returns True if no events are waiting in this EventSource.
+        */
+
+        bool isEmpty() const;
+
+    private:
+
+        static const uint8_t kNumSlots = EVENTMANAGER_SOURCE_QUEUE_SIZE + 1;
+
+        static uint8_t nextIndex( uint8_t i );
+
+        struct EventElement
+        {
+            int code;
+            int param;
+        };
+
+        EventElement        mEvents[ kNumSlots ];
+        volatile uint8_t    mHead;      // Written only by the consumer
+        volatile uint8_t    mTail;      // Written only by the producer
+
+        bool popEvent( int* eventCode, int* eventParam );
+
+        friend bool popSourceEvent( int* eventCode, int* eventParam );
+    };
+
+
+
+    /*!
+    * \brief The order in which events from registered EventSources are merged.
+    *
+    * \hideinitializer
+    */
+
+    enum EventSourcePolicy
+    {
+        kSourceFixedOrder,      //!< Sources registered earlier are always drained first
+        kSourceRoundRobin       //!< Sources take turns, one event at a time
+    };
+
+
+
+    /*!
+    * \brief Register an EventSource with EventManager.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_EVENT_SOURCES is defined to be non-zero.
+    *
+    * \arg \c source the EventSource to register.
+    *
+    * \returns True if successful; false if \c source is null or \c EVENTMANAGER_MAX_EVENT_SOURCES
+    * sources are already registered.
+    */
+
+    bool addEventSource( EventSource* source );
+
+
+
+    /*!
+    * \brief Unregister an EventSource.  Events remaining in the source are not processed.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_EVENT_SOURCES is defined to be non-zero.
+    *
+    * \arg \c source the EventSource to unregister.
+    *
+    * \returns True if successful; false if \c source was not registered.
+    */
+
+    bool removeEventSource( EventSource* source );
+
+
+
+    /*!
+    * \brief Set the order in which events from registered EventSources are processed.
+    *
+    * \note Only available if \c EVENTMANAGER_MAX_EVENT_SOURCES is defined to be non-zero.
+    *
+    * \arg \c policy kSourceFixedOrder (the default) or kSourceRoundRobin.
+    */
+
+    void setEventSourcePolicy( EventSourcePolicy policy );
+
+#endif
+
+
+
+#if EVENTMANAGER_IDLE_SLEEP
+
+    /*!
+    * \brief Sleep when there are no events to process.
+    *
+    * When idle sleep is enabled, a call to processEvent() or processAllEvents() that finds no
+    * event to process puts the processor to sleep, in the given sleep mode, until the next
+    * interrupt, and then returns 0.  The check that there are no events and entering sleep
+    * are done so that an event queued by an interrupt in between cannot be missed.
+    *
+    * Use a sleep mode that the interrupts queuing your events can wake the processor from.
+    *
+    * \note Only available if \c EVENTMANAGER_IDLE_SLEEP is defined to be 1.
+    *
+    * \arg \c enable true to enable idle sleep, false (the default) to disable it.
+    * \arg \c sleepMode one of the \c SLEEP_MODE_ constants from \c <avr/sleep.h>.
+    * Defaults to \c SLEEP_MODE_IDLE.
+    */
+
+    void enableIdleSleep( bool enable, uint8_t sleepMode = SLEEP_MODE_IDLE );
+
+#endif
+
+
+
+#if EVENTMANAGER_IDLE_SLEEP && EVENTMANAGER_NUM_TIMERS
+
+    /*!
+    * \brief Set a hook that lets idle sleep last until the next event timer expires (tickless idle).
+    *
+    * Right before the processor goes to sleep (see enableIdleSleep()), EventManager calls
+    * \c hook, with interrupts disabled, with the number of ticks until the next event timer
+    * expires.  The hook should program a hardware timer compare interrupt to wake the processor
+    * at that time, so that the periodic tick interrupt can be stopped (or ignored) while asleep
+    * and the processor only wakes when there is work to do.
+    *
+    * \note Only available if both \c EVENTMANAGER_IDLE_SLEEP and \c EVENTMANAGER_NUM_TIMERS are
+    * enabled.
+    *
+    * \arg \c hook the wakeup hook, or null to remove it.
+    */
+
+    void setTicklessWakeupHook( TicklessWakeupHook hook );
+
+#endif
+
+
+
+    /*!
+    * \brief Bound how long low priority events can be starved by high priority events.
+    *
+    * By default, scheduling is strict: a low priority event is only processed when there are
+    * no high priority events.  A steady stream of high priority events can therefore starve
+    * the low priority queue indefinitely.  Setting a non-zero \c ratio guarantees that a waiting
+    * low priority event is processed at least once for every \c ratio high priority events.
+    *
+    * \arg \c ratio the maximum number of high priority events processed in a row while low priority
+    * events are waiting, or 0 for strict priority (the default).
+    */
+
+    void setLowPriorityServiceRatio( uint8_t ratio );
+
+
+
+    /*!
+    * \brief Processes one event from the event queue and
+    * dispatches it to the corresponding listeners stored in the dispatch table.
+    *
+    * Events are taken preferentially from the high priority queue.  If the high priority queue is empty,
+    * then events are taken from the low prioirty queue.  (If a low priority service ratio is set using
+    * setLowPriorityServiceRatio(), a waiting low priority event is taken once the ratio is reached.)
+    *
+    * All listeners associated with the event that are enabled will be called.  Disabled listeners are not called.
+    *
+    * The event processed is removed from the event queue (even if there is no listener to handle it).
+    *
+    * \note This function should be called regularly to keep the event queues from getting full.  This is usually
+    * done by calling it inside an event processing loop.
+    *
+    * \returns The number of event handlers called.
+    */
+
+    int processEvent();
 
 
 
@@ -388,7 +1831,8 @@ namespace EventManager
     * stored in the dispatch table.
     *
     * Events are taken preferentially from the high priority queue.  If the high priority queue is empty,
-    * then events are taken from the low prioirty queue.
+    * then events are taken from the low prioirty queue.  (If a low priority service ratio is set using
+    * setLowPriorityServiceRatio(), a waiting low priority event is taken once the ratio is reached.)
     *
     * All listeners associated with the event that are enabled will be called.  Disabled listeners are not called.
     *
@@ -398,7 +1842,8 @@ namespace EventManager
     * this function might not return for a long time.  If events are added as quickly as this function
     * processes them, this function will never return.  .
     *
-    * \returns The number of event handlers called.
+    * \returns The number of event handlers called (for event codes with a batch listener, each
+    * listener counts once per run of events; see addBatchListener()).
     */
 
     int processAllEvents();
@@ -408,4 +1853,119 @@ namespace EventManager
 
 
 
+/*!
+* \brief Declare an event code registry named \c name and check its blocks at compile time.
+*
+* The arguments after \c name are those of EventManager::EventCodeRegistry: the first event code
+* of the registry, followed by the event code blocks in order.  Use at file or namespace scope:
+* \code
+* EVENTMANAGER_EVENT_CODE_REGISTRY( AppEvents, EventManager::kEventUser9 + 1, KeypadEvents, SensorEvents );
+* \endcode
+*
+* The build fails if the blocks overlap (conflicting event codes), leave gaps, or extend past
+* \c EVENTMANAGER_NUM_EVENT_CODES.  \c AppEvents::kFirst through \c AppEvents::kEnd - 1 are then
+* a dense range of event codes, so a table of \c AppEvents::kCount entries can be indexed directly.
+*
+* \hideinitializer
+*/
+
+#define EVENTMANAGER_EVENT_CODE_REGISTRY( name, ... ) \
+    typedef EventManager::EventCodeRegistry< __VA_ARGS__ > name; \
+    static_assert( name::kValid, "Invalid event code registry " #name )
+
+
+
+
+#if EVENTMANAGER_SECTION_LISTENERS
+
+#define EVENTMANAGER_CONCAT_( a, b )     a ## b
+#define EVENTMANAGER_CONCAT( a, b )      EVENTMANAGER_CONCAT_( a, b )
+
+/*!
+* \brief Register a listener at link time, without any RAM or startup code.
+*
+* Use at file scope, in any source file:
+* \code
+* EVENTMANAGER_REGISTER_LISTENER( EventManager::kEventKeyPress, keyListener );
+* \endcode
+*
+* Each use places an (event, listener) pair (an EventManager::ListenerTableEntry) in the linker
+* section \c evtmgr_listeners.  When an event is dispatched, EventManager calls the registered
+* listeners for it after the listeners in the dispatch table.  Registered listeners cannot be
+* removed or disabled.
+*
+* \warning The linker must place the \c evtmgr_listeners section in flash and keep it, and must
+* define \c __start_evtmgr_listeners and \c __stop_evtmgr_listeners at its bounds.  GNU ld defines
+* these symbols automatically, but where it places such a section depends on the linker script,
+* so add the section to the \c .text output section of your linker script:
+* \code
+* PROVIDE( __start_evtmgr_listeners = . ) ;
+* KEEP( *(evtmgr_listeners) )
+* PROVIDE( __stop_evtmgr_listeners = . ) ;
+* \endcode
+*
+* \note Only available if \c EVENTMANAGER_SECTION_LISTENERS is defined to be non-zero.
+*
+* \hideinitializer
+*/
+
+#define EVENTMANAGER_REGISTER_LISTENER( eventCode, listener ) \
+    static const EventManager::ListenerTableEntry EVENTMANAGER_CONCAT( evtmgrListener_, __LINE__ ) \
+    __attribute__(( used, section( "evtmgr_listeners" ) )) = { ( eventCode ), ( listener ) }
+
+#endif
+
+
+
+
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+
+//*********  INLINES   EventManager::EventSource::  ***********
+
+constexpr EventManager::EventSource::EventSource() :
+mEvents{},
+mHead( 0 ),
+mTail( 0 )
+{
+}
+
+
+inline uint8_t EventManager::EventSource::nextIndex( uint8_t i )
+{
+    return ( i + 1 < kNumSlots ) ? i + 1 : 0;
+}
+
+
+inline bool EventManager::EventSource::isEmpty() const
+{
+    return mHead == mTail;
+}
+
+
+inline bool EventManager::EventSource::queueEvent( int eventCode, int eventParam )
+{
+    // Single producer: only this function writes mTail, and one slot is always left empty
+    // so that a full queue can be told apart from an empty one without a shared count
+    uint8_t tail = mTail;
+    uint8_t next = nextIndex( tail );
+    if ( next == mHead )
+    {
+        return false;
+    }
+
+    mEvents[ tail ].code = eventCode;
+    mEvents[ tail ].param = eventParam;
+
+    // Publish the event only after it is completely written
+    __asm__ __volatile__ ( "" ::: "memory" );
+    mTail = next;
+
+    return true;
+}
+
+#endif
+
+
+
+
 #endif
@@ -0,0 +1,1219 @@
+/*
+ * EventManagerTest.ino
+ * On-target regression tests for EventManager.
+ *
+ * Upload to any AVR board and open the serial monitor (9600 baud).  Each test prints
+ * its name followed by "ok" or "FAILED"; a summary line follows once all tests have run.
+ *
+ * Some tests exercise optional features and are only compiled when those features are
+ * enabled (pass the same -D options to the compiler for this sketch and for EventManager.cpp).
+ *
+ * Copyright (c) 2017 Igor Mikolic-Torreira
+ *
+ * This library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser
+ * General Public License as published by the Free Software
+ * Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser
+ * General Public License along with this library; if not,
+ * write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ */
+
+
+#include "EventManager.h"
+
+
+
+int gFailures;
+
+
+void check( const char* name, bool passed )
+{
+    Serial.print( name );
+    Serial.println( passed ? " ok" : " FAILED" );
+    if ( !passed )
+    {
+        gFailures++;
+    }
+}
+
+
+
+
+// Listeners shared by the tests.  The recording listeners append a decimal digit to gRecord
+// for each call, so a test can check both which events were dispatched and their order.
+
+int gRecord;
+
+void ignoreListener( int, int )
+{
+}
+
+void recordCodeListener( int eventCode, int )
+{
+    gRecord = gRecord * 10 + ( eventCode - EventManager::kEventUser0 );
+}
+
+void recordParamListener( int, int param )
+{
+    gRecord = gRecord * 10 + param;
+}
+
+void recordOneListener( int, int )
+{
+    gRecord = gRecord * 10 + 1;
+}
+
+void recordTwoListener( int, int )
+{
+    gRecord = gRecord * 10 + 2;
+}
+
+
+// A tick source the tests can set the time of
+
+uint16_t gTestTick;
+
+uint16_t testTickSource()
+{
+    return gTestTick;
+}
+
+
+
+
+// Listeners can be added from the constructors of global objects, before setup() runs
+// (the dispatch table is constant-initialized)
+
+int gEarlyCalls;
+
+void earlyListener( int, int )
+{
+    gEarlyCalls++;
+}
+
+struct EarlyListenerInstaller
+{
+    EarlyListenerInstaller()
+    {
+        EventManager::addListener( EventManager::kEventUser0, earlyListener );
+    }
+};
+
+EarlyListenerInstaller gEarlyListenerInstaller;
+
+
+void testListenerAddedBeforeSetup()
+{
+    gEarlyCalls = 0;
+    EventManager::queueEvent( EventManager::kEventUser0, 0 );
+    EventManager::processAllEvents();
+    bool called = ( gEarlyCalls == 1 );
+
+    bool removed = EventManager::removeListener( EventManager::kEventUser0, earlyListener );
+
+    check( "listener added before setup", called && removed && EventManager::isListenerListEmpty() );
+}
+
+
+
+
+#if EVENTMANAGER_RANGE_LISTENERS
+
+// Range and mask listeners are called for every event code they cover
+
+void testRangeAndMaskListeners()
+{
+    EventManager::addRangeListener( EventManager::kEventUser1, EventManager::kEventUser3, recordCodeListener );
+
+    gRecord = 0;
+    for ( int code = EventManager::kEventUser0; code <= EventManager::kEventUser5; code++ )
+    {
+        EventManager::queueEvent( code, 0 );
+    }
+    EventManager::processAllEvents();
+    bool range = ( gRecord == 123 );
+
+    EventManager::removeRangeListener( EventManager::kEventUser1, EventManager::kEventUser3, recordCodeListener );
+
+    // All bits but the lowest: matches kEventUser4 and the event code that differs from it in bit 0
+    EventManager::addMaskListener( ~1, EventManager::kEventUser4, recordCodeListener );
+
+    gRecord = 0;
+    for ( int code = EventManager::kEventUser0; code <= EventManager::kEventUser5; code++ )
+    {
+        EventManager::queueEvent( code, 0 );
+    }
+    EventManager::processAllEvents();
+    int lo = ( EventManager::kEventUser4 & ~1 ) - EventManager::kEventUser0;
+    bool mask = ( gRecord == lo * 10 + lo + 1 );
+
+    bool removed = EventManager::removeMaskListener( ~1, EventManager::kEventUser4, recordCodeListener );
+
+    check( "range and mask listeners", range && mask && removed );
+}
+
+#endif
+
+
+
+
+// Entries in a disabled listener group are not called
+
+void testListenerGroups()
+{
+    EventManager::addListener( EventManager::kEventUser1, recordOneListener, 3 );
+    EventManager::addListener( EventManager::kEventUser1, recordTwoListener );
+
+    gRecord = 0;
+    EventManager::enableListenerGroup( 3, false );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::processAllEvents();
+    bool disabled = ( gRecord == 2 ) && !EventManager::isListenerGroupEnabled( 3 );
+
+    gRecord = 0;
+    EventManager::enableListenerGroup( 3, true );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::processAllEvents();
+    bool enabled = ( gRecord == 12 );
+
+    EventManager::removeListener( recordOneListener );
+    EventManager::removeListener( recordTwoListener );
+
+    check( "listener groups", disabled && enabled );
+}
+
+
+
+
+// A one-shot listener that re-arms itself must be called once per event, not again for
+// the event that is being dispatched when it re-arms
+
+int gRearmCalls;
+
+void rearmingListener( int eventCode, int )
+{
+    gRearmCalls++;
+    EventManager::addOneShotListener( eventCode, rearmingListener );
+}
+
+
+void testOneShotRearm()
+{
+    gRearmCalls = 0;
+    EventManager::addOneShotListener( EventManager::kEventUser0, rearmingListener );
+
+    EventManager::queueEvent( EventManager::kEventUser0, 0 );
+    EventManager::processAllEvents();
+    bool once = ( gRearmCalls == 1 ) && ( EventManager::numListeners() == 1 );
+
+    EventManager::queueEvent( EventManager::kEventUser0, 0 );
+    EventManager::processAllEvents();
+    bool twice = ( gRearmCalls == 2 ) && ( EventManager::numListeners() == 1 );
+
+    EventManager::removeListener( rearmingListener );
+
+    // Re-arming must also work when the re-armed entry fills the dispatch table
+    gRearmCalls = 0;
+    while ( EventManager::addListener( EventManager::kEventUser1, ignoreListener ) )
+    {
+    }
+    EventManager::removeListener( EventManager::kEventUser1, ignoreListener );
+    bool armed = EventManager::addOneShotListener( EventManager::kEventUser0, rearmingListener );
+
+    EventManager::queueEvent( EventManager::kEventUser0, 0 );
+    EventManager::processAllEvents();
+    EventManager::queueEvent( EventManager::kEventUser0, 0 );
+    EventManager::processAllEvents();
+    bool full = armed && ( gRearmCalls == 2 ) && EventManager::isListenerListFull();
+
+    EventManager::removeListener( rearmingListener );
+    EventManager::removeListener( ignoreListener );
+
+    check( "one-shot re-arm", once && twice && full );
+}
+
+
+
+
+// Removing a null listener from inside a listener must neither match an entry retired
+// during the dispatch (looping forever) nor report a removal
+
+int gNullRemovals;
+
+void nullRemovingListener( int eventCode, int )
+{
+    gNullRemovals = EventManager::removeListener( static_cast<EventManager::EventListener>( 0 ) )
+        + EventManager::removeListener( static_cast<EventManager::EventConsumer>( 0 ) )
+        + EventManager::removeListener( eventCode, static_cast<EventManager::EventListener>( 0 ) );
+}
+
+
+void testRemoveNullDuringDispatch()
+{
+    gNullRemovals = -1;
+    EventManager::addOneShotListener( EventManager::kEventUser3, ignoreListener );
+    EventManager::addListener( EventManager::kEventUser3, nullRemovingListener );
+
+    EventManager::queueEvent( EventManager::kEventUser3, 0 );
+    EventManager::processAllEvents();
+    bool ignored = ( gNullRemovals == 0 ) && ( EventManager::numListeners() == 1 );
+
+    EventManager::removeListener( nullRemovingListener );
+
+    check( "remove null during dispatch", ignored );
+}
+
+
+
+
+// An event consumed by a consuming listener is not seen by the listeners after it
+
+bool consumeOnes( int, int param )
+{
+    return param == 1;
+}
+
+
+void testConsumingListener()
+{
+    EventManager::addConsumingListener( EventManager::kEventUser1, consumeOnes );
+    EventManager::addListener( EventManager::kEventUser1, recordParamListener );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser1, 1 );
+    EventManager::queueEvent( EventManager::kEventUser1, 2 );
+    EventManager::processAllEvents();
+    bool consumed = ( gRecord == 2 );
+
+    EventManager::removeListener( consumeOnes );
+    EventManager::removeListener( recordParamListener );
+
+    check( "consuming listener", consumed );
+}
+
+
+
+
+#if EVENTMANAGER_LISTENER_PRIORITIES
+
+// Listeners are called in order of descending priority, whatever the order they were added in
+
+void testListenerPriorities()
+{
+    EventManager::addListener( EventManager::kEventUser1, recordOneListener, 0, -5 );
+    EventManager::addListener( EventManager::kEventUser1, recordTwoListener, 0, 5 );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::processAllEvents();
+    bool ordered = ( gRecord == 21 );
+
+    EventManager::removeListener( recordOneListener );
+    EventManager::removeListener( recordTwoListener );
+
+    check( "listener priorities", ordered );
+}
+
+#endif
+
+
+
+
+// With a low priority service ratio of 2, a waiting low priority event is processed after
+// at most two high priority events
+
+void testLowPriorityServiceRatio()
+{
+    EventManager::setLowPriorityServiceRatio( 2 );
+    EventManager::addListener( EventManager::kEventUser1, recordCodeListener );
+    EventManager::addListener( EventManager::kEventUser2, recordCodeListener );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser2, 0, EventManager::kLowPriority );
+    for ( int i = 0; i < 4; i++ )
+    {
+        EventManager::queueEvent( EventManager::kEventUser1, 0, EventManager::kHighPriority );
+    }
+    EventManager::processAllEvents();
+    bool serviced = ( gRecord == 11211 );
+
+    EventManager::removeListener( recordCodeListener );
+    EventManager::setLowPriorityServiceRatio( 0 );
+
+    check( "low priority service ratio", serviced );
+}
+
+
+
+
+#if EVENTMANAGER_DEADLINE_QUEUE
+
+// Events with deadlines are processed earliest deadline first, ahead of high priority events
+
+void testDeadlineQueue()
+{
+    EventManager::addListener( EventManager::kEventUser1, recordCodeListener );
+    EventManager::addListener( EventManager::kEventUser2, recordCodeListener );
+    EventManager::addListener( EventManager::kEventUser3, recordCodeListener );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser3, 0, EventManager::kHighPriority );
+    EventManager::queueEventWithDeadline( EventManager::kEventUser1, 0, 50 );
+    EventManager::queueEventWithDeadline( EventManager::kEventUser2, 0, 10 );
+    EventManager::processAllEvents();
+    bool ordered = ( gRecord == 213 );
+
+    EventManager::removeListener( recordCodeListener );
+
+    check( "deadline queue", ordered );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+
+// An event that waits longer than its time-to-live is discarded; the age of the event being
+// dispatched is available to its listeners
+
+uint16_t gEventAge;
+
+void ageListener( int, int )
+{
+    gEventAge = EventManager::getEventAge();
+}
+
+
+void testTimeToLive()
+{
+    gTestTick = 100;
+    gEventAge = 0xFFFF;
+    EventManager::setTickSource( testTickSource );
+    EventManager::setEventTimeToLive( EventManager::kEventUser1, 5 );
+    EventManager::addListener( EventManager::kEventUser1, ageListener );
+
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    gTestTick += 10;
+    EventManager::processAllEvents();
+    bool expired = ( gEventAge == 0xFFFF );
+
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    gTestTick += 2;
+    EventManager::processAllEvents();
+    bool live = ( gEventAge == 2 );
+
+    EventManager::removeListener( ageListener );
+    EventManager::setEventTimeToLive( EventManager::kEventUser1, 0 );
+    EventManager::setTickSource( 0 );
+
+    check( "time-to-live", expired && live );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_RATE_LIMITS
+
+// Events rejected because the queue is full (or merged with an identical pending event) must
+// not use up the rate limit of their event code
+
+void testRateLimitWithFullQueue()
+{
+    EventManager::setEventRateLimit( EventManager::kEventUser4, 0, 2 );
+    while ( EventManager::queueEvent( EventManager::kEventUser5, 0, EventManager::kHighPriority ) )
+    {
+    }
+
+    bool rejected = true;
+    for ( int i = 0; i < 3; i++ )
+    {
+        rejected = rejected && !EventManager::queueEvent( EventManager::kEventUser4, i, EventManager::kHighPriority );
+    }
+    EventManager::processAllEvents();
+
+    // Both tokens must still be available...
+#if EVENTMANAGER_DEDUPLICATION
+    EventManager::enableEventDeduplication( EventManager::kEventUser4, true );
+#endif
+    bool first = EventManager::queueEvent( EventManager::kEventUser4, 1, EventManager::kHighPriority );
+
+#if EVENTMANAGER_DEDUPLICATION
+    // ...and events merged with the pending one don't use up the second
+    for ( int i = 0; i < 3; i++ )
+    {
+        first = first && EventManager::queueEvent( EventManager::kEventUser4, 1, EventManager::kHighPriority );
+    }
+    EventManager::enableEventDeduplication( EventManager::kEventUser4, false );
+#endif
+
+    bool second = EventManager::queueEvent( EventManager::kEventUser4, 2, EventManager::kHighPriority );
+    bool third = EventManager::queueEvent( EventManager::kEventUser4, 3, EventManager::kHighPriority );
+    EventManager::processAllEvents();
+    EventManager::setEventRateLimit( EventManager::kEventUser4, 0, 0 );
+
+    check( "rate limit with full queue", rejected && first && second && !third );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_DEDUPLICATION
+
+// An event identical to the most recently queued event with its code is merged with it;
+// alternating parameters are all queued
+
+void testDeduplication()
+{
+    EventManager::enableEventDeduplication( EventManager::kEventUser1, true );
+    EventManager::addListener( EventManager::kEventUser1, recordParamListener );
+
+    gRecord = 0;
+    bool accepted = EventManager::queueEvent( EventManager::kEventUser1, 1 );
+    accepted = EventManager::queueEvent( EventManager::kEventUser1, 1 ) && accepted;
+    accepted = EventManager::queueEvent( EventManager::kEventUser1, 2 ) && accepted;
+    accepted = EventManager::queueEvent( EventManager::kEventUser1, 1 ) && accepted;
+    EventManager::processAllEvents();
+    bool merged = accepted && ( gRecord == 121 );
+
+    EventManager::removeListener( recordParamListener );
+    EventManager::enableEventDeduplication( EventManager::kEventUser1, false );
+
+    check( "deduplication", merged );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_PAINT_SCHEDULER
+
+// Invalidated regions are merged into one kEventPaint event covering their bounding box
+
+int gPaintRegion[ 4 ];
+
+void paintRegionListener( int, int )
+{
+    gRecord++;
+    EventManager::getPaintRegion( &gPaintRegion[ 0 ], &gPaintRegion[ 1 ], &gPaintRegion[ 2 ], &gPaintRegion[ 3 ] );
+}
+
+
+void testPaintRegionMerge()
+{
+    EventManager::addListener( EventManager::kEventPaint, paintRegionListener );
+
+    gRecord = 0;
+    EventManager::invalidateRegion( 0, 5, 10, 10 );
+    EventManager::invalidateRegion( 5, 0, 20, 8 );
+    EventManager::processAllEvents();
+    bool merged = ( gRecord == 1 ) && ( gPaintRegion[ 0 ] == 0 ) && ( gPaintRegion[ 1 ] == 0 )
+        && ( gPaintRegion[ 2 ] == 20 ) && ( gPaintRegion[ 3 ] == 10 );
+
+    int x0, y0, x1, y1;
+    bool cleared = !EventManager::getPaintRegion( &x0, &y0, &x1, &y1 );
+
+    EventManager::removeListener( paintRegionListener );
+
+    check( "paint region merge", merged && cleared );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_EVENT_TIMESTAMPS && EVENTMANAGER_PAINT_SCHEDULER
+
+// A scheduled kEventPaint that expires (time-to-live) before it is dispatched must not stop
+// the paint scheduler from scheduling the next paint
+
+int gPaintCalls;
+
+void paintListener( int, int )
+{
+    gPaintCalls++;
+}
+
+void testPaintAfterExpiredPaint()
+{
+    gTestTick = 0;
+    gPaintCalls = 0;
+    EventManager::setTickSource( testTickSource );
+    EventManager::setPaintInterval( 0 );
+    EventManager::setEventTimeToLive( EventManager::kEventPaint, 5 );
+    EventManager::addListener( EventManager::kEventPaint, paintListener );
+    EventManager::addListener( EventManager::kEventUser1, ignoreListener );
+
+    // The paint is scheduled, but a high priority event is processed ahead of it...
+    EventManager::queueEvent( EventManager::kEventUser1, 0, EventManager::kHighPriority );
+    EventManager::invalidateRegion( 0, 0, 10, 10 );
+    EventManager::processEvent();
+
+    // ...and by the time the main loop gets to it, the paint has expired
+    gTestTick = 10;
+    EventManager::processAllEvents();
+
+    // Further processing must schedule (and dispatch) a new paint
+    EventManager::processAllEvents();
+    bool repainted = ( gPaintCalls == 1 );
+
+    int x0, y0, x1, y1;
+    EventManager::getPaintRegion( &x0, &y0, &x1, &y1 );
+    EventManager::removeListener( paintListener );
+    EventManager::removeListener( ignoreListener );
+    EventManager::setEventTimeToLive( EventManager::kEventPaint, 0 );
+    EventManager::setTickSource( 0 );
+
+    check( "paint after expired paint", repainted );
+}
+
+#endif
+
+
+
+
+// The event queue holds EVENTMANAGER_EVENT_QUEUE_SIZE events and returns them in order
+// (this exercises the multi-producer queue when EVENTMANAGER_MPSC_QUEUE is set)
+
+int gNextParam;
+bool gInOrder;
+
+void orderCheckListener( int, int param )
+{
+    gInOrder = gInOrder && ( param == gNextParam );
+    gNextParam++;
+}
+
+
+void testEventQueueOrder()
+{
+    EventManager::addListener( EventManager::kEventUser1, orderCheckListener );
+
+    int queued = 0;
+    while ( EventManager::queueEvent( EventManager::kEventUser1, queued, EventManager::kHighPriority ) )
+    {
+        queued++;
+    }
+    bool full = ( queued == EVENTMANAGER_EVENT_QUEUE_SIZE ) && EventManager::isEventQueueFull( EventManager::kHighPriority );
+
+    gNextParam = 0;
+    gInOrder = true;
+    EventManager::processAllEvents();
+    bool drained = gInOrder && ( gNextParam == queued ) && EventManager::isEventQueueEmpty( EventManager::kHighPriority );
+
+    EventManager::removeListener( orderCheckListener );
+
+    check( "event queue order", full && drained );
+}
+
+
+
+
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+
+// When processEvent() finds no listener for a high priority event, it must move on to the
+// event sources before the low priority queue
+
+void testSourceOrderAfterUnhandledEvent()
+{
+    EventManager::EventSource source;
+    EventManager::addEventSource( &source );
+    EventManager::addListener( EventManager::kEventUser8, recordCodeListener );
+    EventManager::addListener( EventManager::kEventUser9, recordCodeListener );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser9, 0, EventManager::kLowPriority );
+    source.queueEvent( EventManager::kEventUser8, 0 );
+    EventManager::queueEvent( EventManager::kEventUser7, 0, EventManager::kHighPriority );
+    EventManager::processEvent();
+    bool sourceFirst = ( gRecord == 8 );
+
+    EventManager::processAllEvents();
+    bool lowPriorityNext = ( gRecord == 89 );
+
+    EventManager::removeListener( recordCodeListener );
+    EventManager::removeEventSource( &source );
+
+    check( "source order after unhandled event", sourceFirst && lowPriorityNext );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_BACKLOG_SIZE
+
+// processEvent() moves waiting low priority events into the backlog, making room in the
+// event queue; events from both are processed in the order they were queued
+
+void testBacklog()
+{
+    EventManager::addListener( EventManager::kEventUser1, orderCheckListener );
+
+    int queued = 0;
+    while ( EventManager::queueEvent( EventManager::kEventUser1, queued, EventManager::kLowPriority ) )
+    {
+        queued++;
+    }
+
+    gNextParam = 0;
+    gInOrder = true;
+    EventManager::processEvent();
+    int more = 0;
+    while ( EventManager::queueEvent( EventManager::kEventUser1, queued + more, EventManager::kLowPriority ) )
+    {
+        more++;
+    }
+    bool spilled = ( more > 0 ) && ( EventManager::getNumEventsInQueue( EventManager::kLowPriority ) == queued + more - 1 );
+
+    EventManager::processAllEvents();
+    bool drained = gInOrder && ( gNextParam == queued + more );
+
+    EventManager::removeListener( orderCheckListener );
+
+    check( "backlog", spilled && drained );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_BACKLOG_SIZE && EVENTMANAGER_DEDUPLICATION
+
+// A deduplicated event reaching the backlog is only compared with the most recent event
+// with its code already there (the same rule as in the event queue)
+
+void testBacklogDeduplication()
+{
+    EventManager::enableEventDeduplication( EventManager::kEventUser6, true );
+    EventManager::addListener( EventManager::kEventUser6, recordParamListener );
+    EventManager::addListener( EventManager::kEventUser7, ignoreListener );
+
+    // Leave a kEventUser6 event waiting in the backlog
+    EventManager::queueEvent( EventManager::kEventUser7, 0, EventManager::kLowPriority );
+    EventManager::queueEvent( EventManager::kEventUser6, 7, EventManager::kLowPriority );
+    EventManager::processEvent();
+
+    // The duplicate is dropped on its way into the backlog, the new parameter is kept
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser6, 7, EventManager::kLowPriority );
+    EventManager::queueEvent( EventManager::kEventUser6, 8, EventManager::kLowPriority );
+    EventManager::processAllEvents();
+    bool dropped = ( gRecord == 78 );
+
+    // Alternating parameters are all kept
+    EventManager::queueEvent( EventManager::kEventUser7, 0, EventManager::kLowPriority );
+    EventManager::queueEvent( EventManager::kEventUser6, 7, EventManager::kLowPriority );
+    EventManager::processEvent();
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser6, 8, EventManager::kLowPriority );
+    EventManager::queueEvent( EventManager::kEventUser6, 7, EventManager::kLowPriority );
+    EventManager::processAllEvents();
+    bool alternating = ( gRecord == 787 );
+
+    EventManager::removeListener( recordParamListener );
+    EventManager::removeListener( ignoreListener );
+    EventManager::enableEventDeduplication( EventManager::kEventUser6, false );
+
+    check( "backlog deduplication", dropped && alternating );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_QUEUE_WATERMARKS
+
+// The flow control callback throttles at the high watermark and releases at the low one
+
+void watermarkCallback( bool throttle )
+{
+    gRecord = gRecord * 10 + ( throttle ? 1 : 2 );
+}
+
+
+void testQueueWatermarks()
+{
+    bool set = EventManager::setEventQueueWatermarks( EventManager::kHighPriority, 3, 1, watermarkCallback );
+
+    gRecord = 0;
+    for ( int i = 0; i < 3; i++ )
+    {
+        EventManager::queueEvent( EventManager::kEventUser1, 0, EventManager::kHighPriority );
+    }
+    bool throttled = ( gRecord == 1 );
+
+    EventManager::processAllEvents();
+    bool released = ( gRecord == 12 );
+
+    EventManager::setEventQueueWatermarks( EventManager::kHighPriority, 0, 0, 0 );
+
+    check( "queue watermarks", set && throttled && released );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_IDLE_SLEEP
+
+// With idle sleep enabled, processing an empty queue sleeps until the next interrupt (here,
+// the millis() timer) and returns; waiting events are processed without sleeping
+
+void testIdleSleep()
+{
+    EventManager::enableIdleSleep( true );
+    EventManager::addListener( EventManager::kEventUser1, recordOneListener );
+
+    gRecord = 0;
+    bool idle = ( EventManager::processEvent() == 0 );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    bool busy = ( EventManager::processEvent() == 1 ) && ( gRecord == 1 );
+
+    EventManager::removeListener( recordOneListener );
+    EventManager::enableIdleSleep( false );
+
+    check( "idle sleep", idle && busy );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_NUM_TIMERS
+
+// A timer queues its event once it expires, and a periodic timer keeps doing so
+
+void testEventTimers()
+{
+    gTestTick = 0;
+    EventManager::setTickSource( testTickSource );
+    EventManager::addListener( EventManager::kEventUser1, recordCodeListener );
+    EventManager::addListener( EventManager::kEventUser2, recordCodeListener );
+
+    gRecord = 0;
+    bool set = EventManager::setEventTimer( EventManager::kEventUser1, 0, 10 );
+    gTestTick = 5;
+    EventManager::processAllEvents();
+    bool early = ( gRecord == 0 );
+
+    gTestTick = 10;
+    EventManager::processAllEvents();
+    gTestTick = 30;
+    EventManager::processAllEvents();
+    bool once = ( gRecord == 1 ) && !EventManager::cancelEventTimer( EventManager::kEventUser1 );
+
+    gRecord = 0;
+    set = EventManager::setEventTimer( EventManager::kEventUser2, 0, 10, 10 ) && set;
+    gTestTick = 40;
+    EventManager::processAllEvents();
+    gTestTick = 50;
+    EventManager::processAllEvents();
+    bool periodic = ( gRecord == 22 ) && EventManager::cancelEventTimer( EventManager::kEventUser2 );
+
+    EventManager::removeListener( recordCodeListener );
+    EventManager::setTickSource( 0 );
+
+    check( "event timers", set && early && once && periodic );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_IDLE_SLEEP && EVENTMANAGER_NUM_TIMERS
+
+// Before sleeping, the tickless wakeup hook is told how long until the next timer expires
+
+uint16_t gWakeupTicks;
+
+void wakeupHook( uint16_t ticks )
+{
+    gWakeupTicks = ticks;
+}
+
+
+void testTicklessWakeupHook()
+{
+    gTestTick = 0;
+    gWakeupTicks = 0;
+    EventManager::setTickSource( testTickSource );
+    EventManager::setTicklessWakeupHook( wakeupHook );
+    EventManager::enableIdleSleep( true );
+
+    EventManager::setEventTimer( EventManager::kEventUser1, 0, 100 );
+    gTestTick = 40;
+    EventManager::processEvent();
+    bool hooked = ( gWakeupTicks == 60 );
+
+    EventManager::cancelEventTimer( EventManager::kEventUser1 );
+    EventManager::enableIdleSleep( false );
+    EventManager::setTicklessWakeupHook( 0 );
+    EventManager::setTickSource( 0 );
+
+    check( "tickless wakeup hook", hooked );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_DEFAULT_PRIORITIES
+
+// Events queued without a priority get their event code's default priority
+
+void testDefaultPriorities()
+{
+    EventManager::setDefaultEventPriority( EventManager::kEventUser2, EventManager::kHighPriority );
+    EventManager::addListener( EventManager::kEventUser1, recordCodeListener );
+    EventManager::addListener( EventManager::kEventUser2, recordCodeListener );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::queueEvent( EventManager::kEventUser2, 0 );
+    EventManager::processAllEvents();
+    bool ordered = ( gRecord == 21 ) && ( EventManager::getDefaultEventPriority( EventManager::kEventUser2 ) == EventManager::kHighPriority );
+
+    EventManager::removeListener( recordCodeListener );
+    EventManager::setDefaultEventPriority( EventManager::kEventUser2, EventManager::kLowPriority );
+
+    check( "default priorities", ordered );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_MAX_BATCH_SIZE
+
+// A listener that removes or disables itself while handling the first event of a batched
+// run must not be called for the rest of the run
+
+int gBatchCalls;
+int gBatchEvents;
+int gSelfRemovingCalls;
+
+void batchListener( int, const int*, uint8_t count )
+{
+    gBatchCalls++;
+    gBatchEvents += count;
+}
+
+void selfRemovingListener( int eventCode, int )
+{
+    gSelfRemovingCalls++;
+    EventManager::removeListener( eventCode, selfRemovingListener );
+}
+
+void selfDisablingListener( int eventCode, int )
+{
+    gSelfRemovingCalls++;
+    EventManager::enableListener( eventCode, selfDisablingListener, false );
+}
+
+
+void testSelfRemovalDuringBatch()
+{
+    gBatchCalls = 0;
+    gBatchEvents = 0;
+    gSelfRemovingCalls = 0;
+    EventManager::addBatchListener( EventManager::kEventUser2, batchListener );
+    EventManager::addListener( EventManager::kEventUser2, selfRemovingListener );
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        EventManager::queueEvent( EventManager::kEventUser2, i );
+    }
+    EventManager::processAllEvents();
+    bool removed = ( gSelfRemovingCalls == 1 ) && ( gBatchCalls == 1 ) && ( gBatchEvents == 3 );
+
+    gSelfRemovingCalls = 0;
+    EventManager::addListener( EventManager::kEventUser2, selfDisablingListener );
+    for ( int i = 0; i < 3; i++ )
+    {
+        EventManager::queueEvent( EventManager::kEventUser2, i );
+    }
+    EventManager::processAllEvents();
+    bool disabled = ( gSelfRemovingCalls == 1 );
+
+    EventManager::removeListener( batchListener );
+    EventManager::removeListener( selfDisablingListener );
+
+    check( "self-removal during batch", removed && disabled );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_EVENT_COUNTERS
+
+// Events with a counter-only code are counted instead of queued, and the count can be posted
+
+void testEventCounters()
+{
+    EventManager::enableEventCounter( EventManager::kEventUser1, true );
+    EventManager::addListener( EventManager::kEventUser1, recordParamListener );
+
+    bool accepted = true;
+    for ( int i = 0; i < 3; i++ )
+    {
+        accepted = EventManager::queueEvent( EventManager::kEventUser1, 0 ) && accepted;
+    }
+    bool counted = accepted && EventManager::isEventQueueEmpty() && ( EventManager::readAndClearEventCount( EventManager::kEventUser1 ) == 3 );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    bool posted = EventManager::postEventCount( EventManager::kEventUser1 );
+    EventManager::processAllEvents();
+    posted = posted && ( gRecord == 2 ) && !EventManager::postEventCount( EventManager::kEventUser1 );
+
+    EventManager::removeListener( recordParamListener );
+    EventManager::enableEventCounter( EventManager::kEventUser1, false );
+
+    check( "event counters", counted && posted );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_NUM_JOINS
+
+// A join queues its completion event once all the awaited events have been processed
+
+void testEventJoins()
+{
+    EventManager::addEventJoin( EventManager::kEventUser1, 0x03, EventManager::kEventUser3, 7 );
+    EventManager::addListener( EventManager::kEventUser3, recordParamListener );
+
+    gRecord = 0;
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::processAllEvents();
+    bool waiting = ( gRecord == 0 );
+
+    EventManager::queueEvent( EventManager::kEventUser2, 0 );
+    EventManager::processAllEvents();
+    bool completed = ( gRecord == 7 );
+
+    EventManager::removeListener( recordParamListener );
+    bool removed = ( EventManager::removeEventJoin( EventManager::kEventUser3 ) == 1 );
+
+    check( "event joins", waiting && completed && removed );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_LISTENER_TABLES
+
+// The active listener table (in RAM or in flash) is consulted after the dispatch table
+
+const EventManager::ListenerTableEntry gRamTable[] =
+{
+    { EventManager::kEventUser1, recordOneListener }
+};
+
+const EventManager::ListenerTableEntry gFlashTable[] PROGMEM =
+{
+    { EventManager::kEventUser1, recordTwoListener }
+};
+
+
+void testListenerTables()
+{
+    gRecord = 0;
+    EventManager::setActiveListenerTable( gRamTable, 1 );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::processAllEvents();
+
+    EventManager::setActiveListenerTable( gFlashTable, 1, true );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::processAllEvents();
+
+    EventManager::setActiveListenerTable( 0, 0 );
+    EventManager::queueEvent( EventManager::kEventUser1, 0 );
+    EventManager::processAllEvents();
+
+    check( "listener tables", gRecord == 12 );
+}
+
+#endif
+
+
+
+
+#if EVENTMANAGER_SECTION_LISTENERS
+
+// Listeners registered at link time are called like any other
+
+int gSectionCalls;
+
+void sectionListener( int, int )
+{
+    gSectionCalls++;
+}
+
+EVENTMANAGER_REGISTER_LISTENER( EventManager::kEventUser5, sectionListener );
+
+
+void testSectionListeners()
+{
+    gSectionCalls = 0;
+    EventManager::queueEvent( EventManager::kEventUser5, 0 );
+    EventManager::processAllEvents();
+
+    check( "section listeners", gSectionCalls == 1 );
+}
+
+#endif
+
+
+
+
+// Event code blocks are laid out densely after the generic events; declaring the registry
+// checks them at compile time
+
+typedef EventManager::EventCodeBlock< EventManager::kEventUser9 + 1, 2 > TestBlockA;
+typedef EventManager::NextEventCodeBlock< TestBlockA, 1 > TestBlockB;
+EVENTMANAGER_EVENT_CODE_REGISTRY( TestEventCodes, EventManager::kEventUser9 + 1, TestBlockA, TestBlockB );
+
+static_assert( TestEventCodes::kCount == 3 && int( TestEventCodes::kEnd ) == int( TestBlockB::kEnd ), "Unexpected registry extent" );
+static_assert( TestBlockB::code< 0 >() == TestBlockA::code< 1 >() + 1, "Event code blocks are not dense" );
+
+
+void testEventCodeBlocks()
+{
+    EventManager::addListener( TestBlockB::code< 0 >(), recordParamListener );
+
+    gRecord = 0;
+    EventManager::queueEvent( TestBlockA::code< 1 >(), 1 );
+    EventManager::queueEvent( TestBlockB::code< 0 >(), 2 );
+    EventManager::processAllEvents();
+
+    EventManager::removeListener( recordParamListener );
+
+    check( "event code blocks", gRecord == 2 );
+}
+
+
+
+
+void setup()
+{
+    Serial.begin( 9600 );
+
+    // Runs first, while its listener is the only one installed
+    testListenerAddedBeforeSetup();
+
+#if EVENTMANAGER_RANGE_LISTENERS
+    testRangeAndMaskListeners();
+#endif
+    testListenerGroups();
+    testOneShotRearm();
+    testRemoveNullDuringDispatch();
+    testConsumingListener();
+#if EVENTMANAGER_LISTENER_PRIORITIES
+    testListenerPriorities();
+#endif
+    testLowPriorityServiceRatio();
+#if EVENTMANAGER_DEADLINE_QUEUE
+    testDeadlineQueue();
+#endif
+#if EVENTMANAGER_EVENT_TIMESTAMPS
+    testTimeToLive();
+#endif
+#if EVENTMANAGER_RATE_LIMITS
+    testRateLimitWithFullQueue();
+#endif
+#if EVENTMANAGER_DEDUPLICATION
+    testDeduplication();
+#endif
+#if EVENTMANAGER_PAINT_SCHEDULER
+    testPaintRegionMerge();
+#endif
+#if EVENTMANAGER_EVENT_TIMESTAMPS && EVENTMANAGER_PAINT_SCHEDULER
+    testPaintAfterExpiredPaint();
+#endif
+    testEventQueueOrder();
+#if EVENTMANAGER_MAX_EVENT_SOURCES
+    testSourceOrderAfterUnhandledEvent();
+#endif
+#if EVENTMANAGER_BACKLOG_SIZE
+    testBacklog();
+#endif
+#if EVENTMANAGER_BACKLOG_SIZE && EVENTMANAGER_DEDUPLICATION
+    testBacklogDeduplication();
+#endif
+#if EVENTMANAGER_QUEUE_WATERMARKS
+    testQueueWatermarks();
+#endif
+#if EVENTMANAGER_IDLE_SLEEP
+    testIdleSleep();
+#endif
+#if EVENTMANAGER_NUM_TIMERS
+    testEventTimers();
+#endif
+#if EVENTMANAGER_IDLE_SLEEP && EVENTMANAGER_NUM_TIMERS
+    testTicklessWakeupHook();
+#endif
+#if EVENTMANAGER_DEFAULT_PRIORITIES
+    testDefaultPriorities();
+#endif
+#if EVENTMANAGER_MAX_BATCH_SIZE
+    testSelfRemovalDuringBatch();
+#endif
+#if EVENTMANAGER_EVENT_COUNTERS
+    testEventCounters();
+#endif
+#if EVENTMANAGER_NUM_JOINS
+    testEventJoins();
+#endif
+#if EVENTMANAGER_LISTENER_TABLES
+    testListenerTables();
+#endif
+#if EVENTMANAGER_SECTION_LISTENERS
+    testSectionListeners();
+#endif
+    testEventCodeBlocks();
+
+    Serial.print( gFailures );
+    Serial.println( " test(s) failed" );
+}
+
+
+void loop()
+{
+}